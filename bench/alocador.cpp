@@ -0,0 +1,87 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../src/avl.h"
+#include "../src/dados.h"
+#include "../src/slab_allocator.h"
+
+/**
+ * Inserção e destruição de uma AVL com std::allocator e com
+ * tree::SlabAllocator, para chaves int aleatórias e para o nó de Dados (id
+ * texto e DadosDoAnimal com dois monitoramentos), cada uma três vezes.
+ * Uso: alocador [n]
+*/
+template <typename Key, typename Data, typename Allocator>
+using Arvore = AVL<Key, Data, std::less<Key>, Allocator>;
+
+template <typename Allocator, typename Key, typename Data>
+void medir(const char *nome, const std::vector<std::pair<Key, Data>> &elementos) {
+  auto inicio = std::chrono::steady_clock::now();
+  auto arvore = std::make_unique<Arvore<Key, Data, Allocator>>();
+  for (const auto &elemento : elementos) {
+    arvore->insert(elemento);
+  }
+  auto meio = std::chrono::steady_clock::now();
+  std::size_t tamanho = arvore->size();
+  arvore.reset();
+  // Um bloco grande faz o malloc juntar os blocos pequenos liberados, trabalho
+  // que o free de cada nó adia e que a liberação de um slab antecipa
+  ::operator delete(::operator new(64 * 1024));
+  auto fim = std::chrono::steady_clock::now();
+  std::chrono::duration<double, std::milli> insercao = meio - inicio;
+  std::chrono::duration<double, std::milli> destruicao = fim - meio;
+  std::cout << nome << ": " << tamanho << " elementos, insercao "
+            << insercao.count() << " ms, destruicao " << destruicao.count()
+            << " ms\n";
+}
+
+int main(int argc, char *argv[]) {
+  std::size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000000;
+  std::mt19937 gerador(42);
+
+  std::vector<std::pair<int, int>> inteiros(n);
+  for (auto &elemento : inteiros) {
+    elemento.first = elemento.second = static_cast<int>(gerador());
+  }
+  // Alternadas e repetidas, pois o estado do heap deixado por uma medição
+  // afeta a seguinte
+  for (int vez = 0; vez < 3; ++vez) {
+    medir<std::allocator<std::pair<const int, int>>>("int, std::allocator",
+                                                     inteiros);
+    medir<tree::SlabAllocator<std::pair<const int, int>>>(
+        "int, SlabAllocator", inteiros);
+  }
+
+  // Animais com os campos preenchidos, como os lidos do arquivo
+  using Animal = Dados::DadosDoAnimal;
+  std::vector<std::pair<std::string, Animal>> animais(n / 10);
+  for (auto &[id, animal] : animais) {
+    id = std::to_string(gerador());
+    animal.dados.para_cada_campo(
+        [](const std::string &dado, std::string &valor) {
+          valor = "valor de " + dado;
+        });
+    for (int vez = 0; vez < 2; ++vez) {
+      Dados::DadosDeMonitoramento monitoramento;
+      monitoramento.dados.para_cada_campo(
+          [](const std::string &dado, std::string &valor) {
+            valor = "valor de " + dado;
+          });
+      animal.monitoramento.push_back(monitoramento);
+    }
+  }
+  for (int vez = 0; vez < 3; ++vez) {
+    medir<std::allocator<std::pair<const std::string, Animal>>>(
+        "Dados, std::allocator", animais);
+    medir<tree::SlabAllocator<std::pair<const std::string, Animal>>>(
+        "Dados, SlabAllocator", animais);
+  }
+}
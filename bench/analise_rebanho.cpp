@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../src/dados.h"
+
+/**
+ * Resumo de temperatura e peso por espécie numa janela de datas e busca dos
+ * animais com temperatura acima de um limite, sobre "linhas" monitoramentos
+ * (10 milhões por padrão), de três formas: o laço ingênuo, que lê o texto de
+ * cada registro; os kernels escalares sobre as colunas de medidas; e a API
+ * de Dados, com os kernels vetoriais. Confere que as três dão o mesmo
+ * resultado. Uso: analise_rebanho [linhas] [linhas por animal]
+*/
+const char *const NomeDoArquivo = "analise_rebanho.txt";
+const char *const Especies[] = {"onca",     "capivara", "anta",   "tamandua",
+                                "papagaio", "chipanze", "jacare", "lobo-guara"};
+
+using Animal = Dados::DadosDoAnimal;
+using Resumos = std::map<std::string, ResumoDaEspecie>;
+
+double medir_ms(std::chrono::steady_clock::time_point inicio) {
+  std::chrono::duration<double, std::milli> tempo =
+      std::chrono::steady_clock::now() - inicio;
+  return tempo.count();
+}
+
+/// Chama funcao(animal) para cada animal, como um chamador faria hoje
+template <typename Funcao> void para_cada_animal(const Dados &dados,
+                                                 Funcao funcao) {
+  dados.consultar_intervalo(
+      "", "\x7f", [&](const std::string &, const Animal &animal) {
+        funcao(animal);
+      });
+}
+
+/// Acrescenta uma medida, se ela é conhecida
+void somar(Agregado &agregado, float medida) {
+  if (medida == medida) {
+    ++agregado.contagem;
+    agregado.soma += medida;
+    agregado.minimo = std::min(agregado.minimo, medida);
+    agregado.maximo = std::max(agregado.maximo, medida);
+  }
+}
+
+/// Lê o texto de cada registro, como sem as colunas de medidas
+void resumir_ingenuo(const Dados &dados, JanelaDeDias janela,
+                     Resumos &resumos, size_t &acima, float limite) {
+  para_cada_animal(dados, [&](const Animal &animal) {
+    Agregado temperatura;
+    Agregado peso;
+    bool passou = false;
+    for (const Dados::DadosDeMonitoramento &registro : animal.monitoramento) {
+      if (!janela.contem(
+              ler_data(registro.dados[EsquemaDeMonitoramento::DataDaAvaliacao]))) {
+        continue;
+      }
+      float graus =
+          ler_temperatura(registro.dados[EsquemaDeMonitoramento::Temperatura]);
+      float quilos = ler_peso(registro.dados[EsquemaDeMonitoramento::Peso]);
+      somar(temperatura, graus);
+      somar(peso, quilos);
+      passou = passou or graus > limite;
+    }
+    if (temperatura.contagem + peso.contagem > 0) {
+      ResumoDaEspecie &resumo = resumos[animal.dados[EsquemaDoAnimal::Especie]];
+      ++resumo.animais;
+      resumo.temperatura.juntar(temperatura);
+      resumo.peso.juntar(peso);
+    }
+    acima += passou;
+  });
+}
+
+/// Os kernels escalares sobre as colunas de medidas
+void resumir_escalar(const Dados &dados, JanelaDeDias janela, Resumos &resumos,
+                     size_t &acima, float limite) {
+  para_cada_animal(dados, [&](const Animal &animal) {
+    const ColunasDeMonitoramento &medidas = animal.medidas;
+    Agregado temperatura = agregar_escalar(
+        medidas.temperaturas(), medidas.dias(), medidas.size(), janela);
+    Agregado peso = agregar_escalar(medidas.pesos(), medidas.dias(),
+                                    medidas.size(), janela);
+    if (temperatura.contagem + peso.contagem > 0) {
+      ResumoDaEspecie &resumo = resumos[animal.dados[EsquemaDoAnimal::Especie]];
+      ++resumo.animais;
+      resumo.temperatura.juntar(temperatura);
+      resumo.peso.juntar(peso);
+    }
+    acima += contar_acima_escalar(medidas.temperaturas(), medidas.dias(),
+                                  medidas.size(), janela, limite) > 0;
+  });
+}
+
+bool iguais(const Agregado &lhs, const Agregado &rhs) {
+  return lhs.contagem == rhs.contagem and lhs.minimo == rhs.minimo and
+         lhs.maximo == rhs.maximo and
+         std::abs(lhs.soma - rhs.soma) <= 1e-9 * std::abs(rhs.soma) + 1e-6;
+}
+bool iguais(const Resumos &lhs, const Resumos &rhs) {
+  if (lhs.size() != rhs.size()) {
+    return false;
+  }
+  for (const auto &[especie, resumo] : lhs) {
+    auto outro = rhs.find(especie);
+    if (outro == rhs.end() or resumo.animais != outro->second.animais or
+        !iguais(resumo.temperatura, outro->second.temperatura) or
+        !iguais(resumo.peso, outro->second.peso)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Ingere os animais e mede as três formas
+ * \return se elas deram o mesmo resultado
+*/
+bool medir(std::vector<std::pair<std::string, Animal>> animais,
+           size_t linhas) {
+  Dados dados(NomeDoArquivo);
+  auto inicio = std::chrono::steady_clock::now();
+  dados.inserir_animais(std::move(animais));
+  std::cout << linhas << " monitoramentos de " << dados.numero_de_animais()
+            << " animais ingeridos em " << medir_ms(inicio)
+            << " ms (com a conversao para as colunas)\n";
+
+  JanelaDeDias janela{ler_data("01/03/2021"), ler_data("30/09/2023")};
+  float limite = 40.5;
+  Resumos ingenuo, escalar;
+  size_t acima_ingenuo = 0;
+  size_t acima_escalar = 0;
+
+  inicio = std::chrono::steady_clock::now();
+  resumir_ingenuo(dados, janela, ingenuo, acima_ingenuo, limite);
+  std::cout << "laco ingenuo por registro: " << medir_ms(inicio) << " ms\n";
+
+  inicio = std::chrono::steady_clock::now();
+  resumir_escalar(dados, janela, escalar, acima_escalar, limite);
+  std::cout << "kernels escalares nas colunas: " << medir_ms(inicio)
+            << " ms\n";
+
+  inicio = std::chrono::steady_clock::now();
+  Resumos vetorial = dados.resumo_por_especie(janela);
+  size_t acima_vetorial =
+      dados.animais_com_temperatura_acima(limite, janela).size();
+  std::cout << "kernels vetoriais ("
+#if defined(__AVX2__)
+            << "AVX2"
+#elif defined(__SSE2__)
+            << "SSE2"
+#else
+            << "escalar"
+#endif
+            << "): " << medir_ms(inicio) << " ms\n";
+
+  inicio = std::chrono::steady_clock::now();
+  Histograma histograma = dados.histograma_de_temperaturas(35, 41, 12, janela);
+  std::cout << "histograma de temperaturas: " << medir_ms(inicio) << " ms\n";
+
+  for (const auto &[especie, resumo] : vetorial) {
+    std::cout << especie << ": " << resumo.animais << " animais, temperatura "
+              << resumo.temperatura.media() << " (" << resumo.temperatura.minimo
+              << " a " << resumo.temperatura.maximo << "), peso "
+              << resumo.peso.media() << " (" << resumo.peso.minimo << " a "
+              << resumo.peso.maximo << ")\n";
+  }
+  size_t no_histograma = 0;
+  for (size_t contagem : histograma.contagens) {
+    no_histograma += contagem;
+  }
+  size_t na_janela = 0;
+  for (const auto &[especie, resumo] : vetorial) {
+    na_janela += resumo.temperatura.contagem;
+  }
+  std::cout << acima_vetorial << " animais acima de " << limite << " graus\n";
+
+  return iguais(ingenuo, vetorial) and iguais(escalar, vetorial) and
+         acima_ingenuo == acima_vetorial and
+         acima_escalar == acima_vetorial and no_histograma == na_janela;
+} // o destrutor salva os dados
+
+int main(int argc, char *argv[]) {
+  size_t linhas = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000000;
+  size_t por_animal = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100;
+  if (por_animal == 0) {
+    por_animal = 1;
+  }
+
+  std::mt19937 gerador(23);
+  auto texto_do_dia = [&gerador] {
+    return std::to_string(1 + gerador() % 28) + '/' +
+           std::to_string(1 + gerador() % 12) + '/' +
+           std::to_string(2020 + gerador() % 5);
+  };
+  std::vector<std::pair<std::string, Animal>> animais(
+      (linhas + por_animal - 1) / por_animal);
+  for (size_t index = 0; index < animais.size(); ++index) {
+    auto &[id, animal] = animais[index];
+    id = std::to_string(index);
+    animal.dados[EsquemaDoAnimal::Especie] = Especies[gerador() % 8];
+    size_t registros = std::min(por_animal, linhas - index * por_animal);
+    animal.monitoramento.resize(registros);
+    for (Dados::DadosDeMonitoramento &registro : animal.monitoramento) {
+      auto &texto = registro.dados;
+      texto[EsquemaDeMonitoramento::DataDaAvaliacao] = texto_do_dia();
+      texto[EsquemaDeMonitoramento::Temperatura] =
+          std::to_string(35 + gerador() % 60 / 10.0).substr(0, 4);
+      texto[EsquemaDeMonitoramento::Peso] =
+          std::to_string(1 + gerador() % 500) + "kg";
+      texto[EsquemaDeMonitoramento::Altura] =
+          std::to_string(10 + gerador() % 200) + "cm";
+      texto[EsquemaDeMonitoramento::SangueFoiColetado] =
+          gerador() % 2 ? "sim" : "nao";
+    }
+  }
+
+  std::remove(NomeDoArquivo);
+  bool certo = medir(std::move(animais), linhas);
+  std::remove(NomeDoArquivo);
+  if (!certo) {
+    std::cout << "as tres formas deveriam dar o mesmo resultado\n";
+    return EXIT_FAILURE;
+  }
+}
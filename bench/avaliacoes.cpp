@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../src/dados.h"
+
+/**
+ * Registra "avaliacoes" monitoramentos (2 milhões por padrão), em ordem de
+ * data embaralhada, para animais com "por animal" avaliações cada, em dados
+ * sem e com o índice das avaliações por data. Mede a busca das avaliações de
+ * um mês em todo o rebanho de três formas: lendo o texto da data de cada
+ * monitoramento, pelo histórico ordenado de cada animal e pelo índice; e a
+ * avaliação mais recente de cada animal, lendo as datas e em O(1). Confere
+ * que as formas dão o mesmo resultado.
+ * Uso: avaliacoes [avaliacoes] [por animal]
+*/
+const char *const ArquivoSemIndice = "avaliacoes_sem.txt";
+const char *const ArquivoComIndice = "avaliacoes_com.txt";
+
+using Avaliacao = Dados::Avaliacao;
+using Lote = std::vector<std::pair<std::string, Dados::DadosDeMonitoramento>>;
+
+double medir_ms(std::chrono::steady_clock::time_point inicio) {
+  std::chrono::duration<double, std::milli> tempo =
+      std::chrono::steady_clock::now() - inicio;
+  return tempo.count();
+}
+
+/// Lê a data de cada monitoramento, como sem o histórico e o índice
+std::vector<Avaliacao> avaliacoes_lendo_texto(const Dados &dados,
+                                              JanelaDeDias janela) {
+  std::vector<Avaliacao> avaliacoes;
+  dados.consultar_intervalo(
+      "", "\x7f",
+      [&](const std::string &id, const Dados::DadosDoAnimal &animal) {
+        for (size_t linha = 0; linha < animal.monitoramento.size(); ++linha) {
+          std::int32_t dia =
+              ler_data(animal.monitoramento[linha]
+                           .dados[EsquemaDeMonitoramento::DataDaAvaliacao]);
+          if (dia != DiaDesconhecido and janela.contem(dia)) {
+            avaliacoes.push_back(
+                {dia, id, static_cast<std::uint32_t>(linha)});
+          }
+        }
+      });
+  std::sort(avaliacoes.begin(), avaliacoes.end());
+  return avaliacoes;
+}
+
+/// Data da avaliação mais recente de cada animal, lendo todas as datas
+std::vector<std::string> ultimas_lendo_texto(const Dados &dados) {
+  std::vector<std::string> ultimas;
+  dados.consultar_intervalo(
+      "", "\x7f", [&](const std::string &, const Dados::DadosDoAnimal &animal) {
+        std::int32_t mais_recente = DiaDesconhecido;
+        const std::string *texto = nullptr;
+        for (const Dados::DadosDeMonitoramento &monitoramento :
+             animal.monitoramento) {
+          const std::string &data =
+              monitoramento.dados[EsquemaDeMonitoramento::DataDaAvaliacao];
+          std::int32_t dia = ler_data(data);
+          if (dia != DiaDesconhecido and dia >= mais_recente) {
+            mais_recente = dia;
+            texto = &data;
+          }
+        }
+        ultimas.push_back(texto == nullptr ? "" : *texto);
+      });
+  return ultimas;
+}
+
+/// A mesma busca com consultar_ultima_avaliacao, para os ids de 0 a n - 1
+std::vector<std::string> ultimas_em_o1(const Dados &dados,
+                                       const std::vector<std::string> &ids) {
+  std::vector<std::string> ultimas;
+  for (const std::string &id : ids) {
+    std::string texto;
+    dados.consultar_ultima_avaliacao(
+        id, [&texto](const Dados::DadosDeMonitoramento &monitoramento) {
+          texto = monitoramento.dados[EsquemaDeMonitoramento::DataDaAvaliacao];
+        });
+    ultimas.push_back(texto);
+  }
+  return ultimas;
+}
+
+bool medir(const std::vector<std::string> &ids, const Lote &lote) {
+  IndicesDoAnimal indice;
+  indice.avaliacoes_por_data = true;
+  Dados sem_indice(ArquivoSemIndice);
+  Dados com_indice(ArquivoComIndice, indice);
+  for (const std::string &id : ids) {
+    sem_indice.inserir_animal(id, {});
+    com_indice.inserir_animal(id, {});
+  }
+  auto inicio = std::chrono::steady_clock::now();
+  sem_indice.inserir_monitoramentos(lote);
+  double sem = medir_ms(inicio);
+  inicio = std::chrono::steady_clock::now();
+  com_indice.inserir_monitoramentos(lote);
+  std::cout << lote.size() << " avaliacoes de " << ids.size()
+            << " animais registradas em " << sem << " ms sem o indice, "
+            << medir_ms(inicio) << " ms com o indice\n";
+
+  JanelaDeDias marco{ler_data("01/03/2022"), ler_data("31/03/2022")};
+  inicio = std::chrono::steady_clock::now();
+  std::vector<Avaliacao> lidas = avaliacoes_lendo_texto(sem_indice, marco);
+  std::cout << "avaliacoes de marco de 2022 (" << lidas.size()
+            << "): " << medir_ms(inicio) << " ms lendo as datas, ";
+  inicio = std::chrono::steady_clock::now();
+  std::vector<Avaliacao> pelos_historicos = sem_indice.avaliacoes_entre(marco);
+  std::cout << medir_ms(inicio) << " ms pelos historicos, ";
+  inicio = std::chrono::steady_clock::now();
+  std::vector<Avaliacao> indexadas = com_indice.avaliacoes_entre(marco);
+  std::cout << medir_ms(inicio) << " ms pelo indice\n";
+
+  inicio = std::chrono::steady_clock::now();
+  std::vector<std::string> ultimas = ultimas_lendo_texto(com_indice);
+  std::cout << "avaliacao mais recente de cada animal: " << medir_ms(inicio)
+            << " ms lendo as datas, ";
+  std::vector<std::string> ids_em_ordem = ids;
+  std::sort(ids_em_ordem.begin(), ids_em_ordem.end());
+  inicio = std::chrono::steady_clock::now();
+  std::vector<std::string> em_o1 = ultimas_em_o1(com_indice, ids_em_ordem);
+  std::cout << medir_ms(inicio) << " ms em O(1) por animal\n";
+
+  return lidas == pelos_historicos and lidas == indexadas and ultimas == em_o1;
+} // os destrutores salvam os dados
+
+int main(int argc, char *argv[]) {
+  size_t avaliacoes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000000;
+  size_t por_animal = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100;
+  if (por_animal == 0) {
+    por_animal = 1;
+  }
+
+  std::mt19937 gerador(25);
+  std::vector<std::string> ids((avaliacoes + por_animal - 1) / por_animal);
+  for (size_t index = 0; index < ids.size(); ++index) {
+    ids[index] = std::to_string(index);
+  }
+  Lote lote(avaliacoes);
+  for (size_t index = 0; index < avaliacoes; ++index) {
+    auto &[id, monitoramento] = lote[index];
+    id = ids[index / por_animal];
+    monitoramento.dados[EsquemaDeMonitoramento::DataDaAvaliacao] =
+        std::to_string(1 + gerador() % 28) + '/' +
+        std::to_string(1 + gerador() % 12) + '/' +
+        std::to_string(2020 + gerador() % 5);
+  }
+  std::shuffle(lote.begin(), lote.end(), gerador);
+
+  std::remove(ArquivoSemIndice);
+  std::remove(ArquivoComIndice);
+  bool certo = medir(ids, lote);
+  std::remove(ArquivoSemIndice);
+  std::remove(ArquivoComIndice);
+  if (!certo) {
+    std::cout << "as formas deveriam dar o mesmo resultado\n";
+    return EXIT_FAILURE;
+  }
+}
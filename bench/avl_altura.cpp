@@ -0,0 +1,45 @@
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+
+#include "../src/avl.h"
+
+/**
+ * Insere 1M chaves em ordem crescente e depois decrescente, o pior caso de
+ * uma árvore sem balanceamento, e compara a altura com o limite de uma AVL,
+ * 1.44 * log2(n + 2), conferindo os invariantes. Uso: avl_altura [n]
+*/
+template <typename Gerador> void medir(const char *nome, std::size_t n,
+                                       Gerador chave) {
+  AVL<int, int> arvore;
+  auto inicio = std::chrono::steady_clock::now();
+  for (std::size_t index = 0; index < n; ++index) {
+    arvore.insert({chave(index), 0});
+  }
+  std::chrono::duration<double, std::milli> tempo =
+      std::chrono::steady_clock::now() - inicio;
+  double limite = 1.44 * std::log2(static_cast<double>(n) + 2);
+  std::cout << nome << ": n = " << arvore.size()
+            << ", altura = " << arvore.height() << " (limite " << limite
+            << "), " << tempo.count() << " ms\n";
+  if (arvore.height() > limite) {
+    std::cout << "altura acima do limite\n";
+    std::exit(EXIT_FAILURE);
+  }
+  tree::TreeStats estatisticas = arvore.validate();
+  std::cout << "  caminho medio de uma busca: "
+            << estatisticas.average_path_length() << " nos\n";
+  if (!estatisticas.valid) {
+    std::cout << "arvore invalida: " << estatisticas.error << "\n";
+    std::exit(EXIT_FAILURE);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  std::size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+  medir("crescente", n, [](std::size_t index) { return static_cast<int>(index); });
+  medir("decrescente", n,
+        [n](std::size_t index) { return static_cast<int>(n - index); });
+}
@@ -0,0 +1,126 @@
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/dados.h"
+
+/**
+ * Vazão de uma mistura de 90% leituras (id_valido e consultar_fauna) e 10%
+ * escritas (monitoramentos, inserções e remoções) com 1, 2, 4... threads, até
+ * o número de núcleos, comparando DadosConcorrentes com Dados atrás de uma
+ * trava global, como os serviços fazem hoje.
+ * Uso: dados_concorrentes [animais] [operacoes por thread]
+*/
+const char *const NomeDoArquivo = "dados_concorrentes.txt";
+
+/**
+ * Chama funcao(dados) travando uma trava global, ou sem travar nada quando
+ * os dados já se sincronizam
+*/
+template <bool TravaGlobal> struct Chamada {
+  std::mutex trava;
+
+  template <typename DadosT, typename Funcao>
+  void operator()(DadosT &dados, Funcao funcao) {
+    if constexpr (TravaGlobal) {
+      std::lock_guard<std::mutex> travada(trava);
+      funcao(dados);
+    } else {
+      funcao(dados);
+    }
+  }
+};
+
+/**
+ * Roda a mistura com "threads" threads, somando em "encontrados" as leituras
+ * que acharam o animal (o que também impede o compilador de descartá-las)
+ * \return operações por segundo
+*/
+template <typename DadosT, bool TravaGlobal>
+double medir(DadosT &dados, std::size_t animais, std::size_t threads,
+             std::size_t operacoes, std::atomic<std::size_t> &encontrados) {
+  Chamada<TravaGlobal> chamar;
+  auto inicio = std::chrono::steady_clock::now();
+  std::vector<std::thread> trabalhadores;
+  for (std::size_t numero = 0; numero < threads; ++numero) {
+    trabalhadores.emplace_back([&, numero] {
+      std::mt19937 gerador(numero);
+      // Cada thread insere e remove seus próprios ids extras
+      std::string extra = "extra" + std::to_string(numero);
+      std::size_t achados = 0;
+      for (std::size_t operacao = 0; operacao < operacoes; ++operacao) {
+        std::string id = std::to_string(gerador() % animais);
+        unsigned sorteio = gerador() % 100;
+        if (sorteio < 45) {
+          chamar(dados, [&](DadosT &d) { achados += d.id_valido(id); });
+        } else if (sorteio < 90) {
+          chamar(dados, [&](DadosT &d) {
+            achados += d.consultar_fauna(id, [](const auto &) {});
+          });
+        } else if (sorteio < 95) {
+          chamar(dados, [&](DadosT &d) {
+            d.inserir_monitoramento_do_animal(id, {});
+          });
+        } else if (operacao % 2 == 0) {
+          chamar(dados, [&](DadosT &d) { d.inserir_animal(extra, {}); });
+        } else {
+          chamar(dados, [&](DadosT &d) { d.remover_animal(extra); });
+        }
+      }
+      encontrados += achados;
+    });
+  }
+  for (std::thread &trabalhador : trabalhadores) {
+    trabalhador.join();
+  }
+  std::chrono::duration<double> tempo =
+      std::chrono::steady_clock::now() - inicio;
+  return threads * operacoes / tempo.count();
+}
+
+template <typename DadosT, bool TravaGlobal>
+void medir_ate_os_nucleos(const char *nome, std::size_t animais,
+                          std::size_t operacoes) {
+  std::remove(NomeDoArquivo);
+  {
+    DadosT dados(NomeDoArquivo);
+    for (std::size_t index = 0; index < animais; ++index) {
+      dados.inserir_animal(std::to_string(index), {});
+    }
+    std::size_t nucleos = std::thread::hardware_concurrency();
+    for (std::size_t threads = 1;; threads *= 2) {
+      std::atomic<std::size_t> encontrados{0};
+      double vazao = medir<DadosT, TravaGlobal>(dados, animais, threads,
+                                                operacoes, encontrados);
+      std::cout << nome << ", " << threads << " threads: " << vazao
+                << " operacoes/s (" << encontrados << " leituras acharam)\n";
+      if (threads >= nucleos) {
+        break;
+      }
+    }
+  } // o destrutor salva os dados
+  std::remove(NomeDoArquivo);
+}
+
+int main(int argc, char *argv[]) {
+  std::size_t animais =
+      argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+  std::size_t operacoes =
+      argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200000;
+  if (animais == 0) {
+    animais = 1;
+  }
+
+  medir_ate_os_nucleos<Dados, true>("Dados com trava global", animais,
+                                    operacoes);
+  medir_ate_os_nucleos<DadosConcorrentes, false>("DadosConcorrentes", animais,
+                                                 operacoes);
+}
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../src/dados.h"
+
+/**
+ * Insere n animais (1 milhão por padrão) em dados sem índices e em dados com
+ * índices hash para Espécie e Sexo e ordenado para o primeiro dia de
+ * monitoramento, e compara o custo da inserção e das buscas "todos os
+ * chipanzés", "todas as fêmeas de 2021" e "primeiro monitorados em abril de
+ * 2024", que sem índice leem todos os animais. Confere que as duas formas
+ * acham os mesmos ids. Uso: indices [n]
+*/
+const char *const ArquivoSemIndices = "indices_sem.txt";
+const char *const ArquivoComIndices = "indices_com.txt";
+const char *const Especies[] = {"onca",     "capivara", "anta",   "tamandua",
+                                "papagaio", "chipanze", "jacare", "lobo-guara"};
+
+using Animal = Dados::DadosDoAnimal;
+using Lote = std::vector<std::pair<std::string, Animal>>;
+
+double medir_ms(std::chrono::steady_clock::time_point inicio) {
+  std::chrono::duration<double, std::milli> tempo =
+      std::chrono::steady_clock::now() - inicio;
+  return tempo.count();
+}
+
+/// Insere o lote um animal por vez, como a operação 1 do menu
+double inserir(Dados &dados, const Lote &lote) {
+  auto inicio = std::chrono::steady_clock::now();
+  for (const auto &[id, animal] : lote) {
+    dados.inserir_animal(id, animal);
+  }
+  return medir_ms(inicio);
+}
+
+/**
+ * Mede a busca "buscar" nos dois dados
+ * \return se elas acharam os mesmos ids
+*/
+template <typename Buscar>
+bool comparar(const char *busca, const Dados &sem_indices,
+              const Dados &com_indices, Buscar buscar) {
+  auto inicio = std::chrono::steady_clock::now();
+  std::vector<std::string> lidos = buscar(sem_indices);
+  double sem = medir_ms(inicio);
+  inicio = std::chrono::steady_clock::now();
+  std::vector<std::string> indexados = buscar(com_indices);
+  double com = medir_ms(inicio);
+  std::cout << busca << " (" << indexados.size() << " animais): " << sem
+            << " ms lendo todos, " << com << " ms pelo indice\n";
+  return lidos == indexados;
+}
+
+/// Ids de "ids" que também estão em "outros", os dois em ordem
+std::vector<std::string> em_ambos(const std::vector<std::string> &ids,
+                                  const std::vector<std::string> &outros) {
+  std::vector<std::string> comuns;
+  std::set_intersection(ids.begin(), ids.end(), outros.begin(), outros.end(),
+                        std::back_inserter(comuns));
+  return comuns;
+}
+
+bool medir(const Lote &lote) {
+  Dados sem_indices(ArquivoSemIndices);
+  Dados com_indices(ArquivoComIndices,
+                    {{EsquemaDoAnimal::Especie, EsquemaDoAnimal::Sexo},
+                     {EsquemaDoAnimal::PrimeiroDiaDeMonitoramento}});
+  double sem = inserir(sem_indices, lote);
+  double com = inserir(com_indices, lote);
+  std::cout << lote.size() << " animais inseridos em " << sem
+            << " ms sem indices, " << com << " ms com indices\n";
+
+  JanelaDeDias abril_de_2024{ler_data("01/04/2024"), ler_data("30/04/2024")};
+  JanelaDeDias em_2021{ler_data("01/01/2021"), ler_data("31/12/2021")};
+  bool iguais =
+      comparar("chipanzes", sem_indices, com_indices, [](const Dados &dados) {
+        return dados.animais_com(EsquemaDoAnimal::Especie, "chipanze");
+      });
+  iguais = comparar("femeas de 2021", sem_indices, com_indices,
+                    [&](const Dados &dados) {
+                      std::vector<std::string> de_2021 =
+                          dados.animais_com_data_entre(
+                              EsquemaDoAnimal::PrimeiroDiaDeMonitoramento,
+                              em_2021);
+                      std::sort(de_2021.begin(), de_2021.end());
+                      return em_ambos(
+                          dados.animais_com(EsquemaDoAnimal::Sexo, "F"),
+                          de_2021);
+                    }) and
+           iguais;
+  iguais = comparar("primeiro monitorados em abril de 2024", sem_indices,
+                    com_indices,
+                    [&](const Dados &dados) {
+                      return dados.animais_com_data_entre(
+                          EsquemaDoAnimal::PrimeiroDiaDeMonitoramento,
+                          abril_de_2024);
+                    }) and
+           iguais;
+  return iguais;
+} // os destrutores salvam os dados
+
+int main(int argc, char *argv[]) {
+  size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+  std::mt19937 gerador(24);
+  Lote lote(n);
+  for (auto &[id, animal] : lote) {
+    id = std::to_string(gerador());
+    animal.dados[EsquemaDoAnimal::Especie] = Especies[gerador() % 8];
+    animal.dados[EsquemaDoAnimal::Sexo] = gerador() % 2 ? "F" : "M";
+    animal.dados[EsquemaDoAnimal::PrimeiroDiaDeMonitoramento] =
+        std::to_string(1 + gerador() % 28) + '/' +
+        std::to_string(1 + gerador() % 12) + '/' +
+        std::to_string(2020 + gerador() % 5);
+  }
+
+  std::remove(ArquivoSemIndices);
+  std::remove(ArquivoComIndices);
+  bool certo = medir(lote);
+  std::remove(ArquivoSemIndices);
+  std::remove(ArquivoComIndices);
+  if (!certo) {
+    std::cout << "as buscas deveriam achar os mesmos animais\n";
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,87 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../src/dados.h"
+
+/**
+ * Aplica um lote de n animais e depois um de 4n monitoramentos (como vindos
+ * de várias estações de campo) a Dados, uma árvore só, e a DadosFragmentados,
+ * que aplica os lotes em paralelo, um fragmento por thread. Confere que os
+ * dois salvam o mesmo arquivo, em ordem de id.
+ * Uso: ingestao_fragmentada [n]
+*/
+const char *const ArquivoUnico = "ingestao_unica.txt";
+const char *const ArquivoFragmentado = "ingestao_fragmentada.txt";
+
+std::string ler_arquivo(const char *nome) {
+  std::ifstream arquivo(nome);
+  std::stringstream conteudo;
+  conteudo << arquivo.rdbuf();
+  return conteudo.str();
+}
+
+template <typename DadosT>
+void medir(const char *nome, const char *arquivo,
+           const std::vector<std::string> &ids,
+           const std::vector<std::string> &ids_dos_monitoramentos) {
+  std::remove(arquivo);
+  DadosT dados(arquivo);
+  std::vector<std::pair<std::string, typename DadosT::DadosDoAnimal>> animais;
+  for (const std::string &id : ids) {
+    animais.emplace_back(id, typename DadosT::DadosDoAnimal());
+  }
+  std::vector<std::pair<std::string, typename DadosT::DadosDeMonitoramento>>
+      monitoramentos;
+  for (const std::string &id : ids_dos_monitoramentos) {
+    monitoramentos.emplace_back(id, typename DadosT::DadosDeMonitoramento());
+  }
+
+  auto inicio = std::chrono::steady_clock::now();
+  dados.inserir_animais(std::move(animais));
+  auto meio = std::chrono::steady_clock::now();
+  dados.inserir_monitoramentos(std::move(monitoramentos));
+  auto fim = std::chrono::steady_clock::now();
+  std::chrono::duration<double, std::milli> tempo_dos_animais = meio - inicio;
+  std::chrono::duration<double, std::milli> tempo_dos_monitoramentos =
+      fim - meio;
+  std::cout << nome << ": " << dados.numero_de_animais() << " animais em "
+            << tempo_dos_animais.count() << " ms, "
+            << ids_dos_monitoramentos.size() << " monitoramentos em "
+            << tempo_dos_monitoramentos.count() << " ms\n";
+} // o destrutor salva os dados
+
+int main(int argc, char *argv[]) {
+  std::size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+
+  std::mt19937 gerador(7);
+  std::vector<std::string> ids(n);
+  for (std::string &id : ids) {
+    id = std::to_string(gerador());
+  }
+  std::vector<std::string> ids_dos_monitoramentos(4 * n);
+  for (std::string &id : ids_dos_monitoramentos) {
+    id = ids[gerador() % n];
+  }
+
+  std::cout << std::thread::hardware_concurrency() << " nucleos\n";
+  medir<Dados>("Dados", ArquivoUnico, ids, ids_dos_monitoramentos);
+  medir<DadosFragmentados>("DadosFragmentados", ArquivoFragmentado, ids,
+                           ids_dos_monitoramentos);
+  bool iguais = ler_arquivo(ArquivoUnico) == ler_arquivo(ArquivoFragmentado);
+  std::remove(ArquivoUnico);
+  std::remove(ArquivoFragmentado);
+  if (!iguais) {
+    std::cout << "os arquivos salvos deveriam ser iguais\n";
+    return EXIT_FAILURE;
+  }
+}
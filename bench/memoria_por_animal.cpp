@@ -0,0 +1,96 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../src/dados.h"
+#include "../src/intrusive_red_black_tree.h"
+#include "../src/red_black_tree.h"
+#include "../src/red_black_tree_map.h"
+
+/**
+ * Bytes de ligação da árvore por animal em cada nó, e o tempo de inserir n
+ * animais numa tree::RedBlackTreeMap (um nó alocado por animal) e numa
+ * tree::IntrusiveRedBlackTree sobre registros guardados num std::deque, que
+ * já trazem as ligações. Uso: memoria_por_animal [n]
+*/
+using Animal = Dados::DadosDoAnimal;
+
+/**
+ * Registro do modo intrusivo: as ligações vêm no próprio registro
+*/
+struct Registro : tree::RedBlackHook {
+  std::string id;
+  Animal animal;
+};
+struct IdDoRegistro {
+  const std::string &operator()(const Registro &registro) const {
+    return registro.id;
+  }
+};
+
+using Mapa = tree::RedBlackTreeMap<std::string, Animal, std::less<>,
+                                   tree::SlabAllocator<Animal>>;
+using Intrusiva = tree::IntrusiveRedBlackTree<Registro, IdDoRegistro>;
+
+template <typename Funcao> double medir_ms(Funcao funcao) {
+  auto inicio = std::chrono::steady_clock::now();
+  funcao();
+  std::chrono::duration<double, std::milli> tempo =
+      std::chrono::steady_clock::now() - inicio;
+  return tempo.count();
+}
+
+int main(int argc, char *argv[]) {
+  std::size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+
+  std::cout << "ligacoes por no: RedBlackTreeUnique "
+            << sizeof(tree::RedBlackTreeUnique<std::uint64_t>::Node) -
+                   sizeof(std::uint64_t)
+            << " bytes (bool + 3 ponteiros, com preenchimento), "
+               "RedBlackHook "
+            << sizeof(tree::RedBlackHook) << " bytes (cor no ponteiro do pai)\n";
+  std::cout << "bytes por animal: RedBlackTreeMap "
+            << sizeof(Mapa::node) << ", registro intrusivo "
+            << sizeof(Registro) << ", so os dados " << sizeof(std::string) +
+                                                         sizeof(Animal)
+            << "\n";
+
+  std::mt19937 gerador(42);
+  std::vector<std::string> ids(n);
+  for (std::string &id : ids) {
+    id = std::to_string(gerador());
+  }
+
+  Mapa mapa;
+  double tempo_do_mapa = medir_ms([&] {
+    for (const std::string &id : ids) {
+      mapa.try_emplace(id);
+    }
+  });
+  std::deque<Registro> registros;
+  Intrusiva intrusiva;
+  double tempo_intrusivo = medir_ms([&] {
+    for (const std::string &id : ids) {
+      Registro &registro = registros.emplace_back();
+      registro.id = id;
+      if (!intrusiva.insert(registro).second) {
+        registros.pop_back(); // id repetido
+      }
+    }
+  });
+  std::cout << "insercao de " << mapa.size() << " animais: RedBlackTreeMap "
+            << tempo_do_mapa << " ms, intrusiva " << tempo_intrusivo
+            << " ms\n";
+  if (mapa.size() != intrusiva.size()) {
+    std::cout << "as arvores deveriam ter os mesmos ids\n";
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,145 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../src/avl.h"
+#include "../src/dados.h"
+#include "../src/slab_allocator.h"
+
+/**
+ * Carrega um arquivo com n animais e outro com m, metade dos ids repetidos,
+ * e acrescenta os animais do segundo ao primeiro de duas formas: inserindo
+ * um por um e com mesclar, que une as árvores por splits e joins. Mede para
+ * m = n/1000, n/100, n/10 e n, conferindo que as duas formas salvam o mesmo
+ * arquivo. Mede também a mesma união em AVLs de animais com std::allocator,
+ * que une as subárvores em paralelo, e com tree::SlabAllocator, que une
+ * serialmente. Uso: mesclar [n]
+*/
+const char *const ArquivoGrande = "mesclar_grande.txt";
+const char *const ArquivoPequeno = "mesclar_pequeno.txt";
+const char *const ArquivoUmPorUm = "mesclar_um_por_um.txt";
+const char *const ArquivoMesclado = "mesclar_mesclado.txt";
+
+template <typename Allocator>
+using Arvore = AVL<std::string, Dados::DadosDoAnimal, std::less<>, Allocator>;
+
+std::string ler_arquivo(const char *nome) {
+  std::ifstream arquivo(nome);
+  std::stringstream conteudo;
+  conteudo << arquivo.rdbuf();
+  return conteudo.str();
+}
+
+/// Salva os ids num arquivo, como o destrutor de Dados faz
+void salvar(const char *nome, const std::vector<std::string> &ids) {
+  std::remove(nome);
+  Dados dados(nome);
+  for (const std::string &id : ids) {
+    dados.inserir_animal(id, {});
+  }
+}
+
+/// Copia o arquivo "origem" para "destino", de onde os dados serão lidos
+void copiar(const char *origem, const char *destino) {
+  std::ofstream(destino) << ler_arquivo(origem);
+}
+
+double milissegundos(std::chrono::steady_clock::time_point inicio) {
+  std::chrono::duration<double, std::milli> tempo =
+      std::chrono::steady_clock::now() - inicio;
+  return tempo.count();
+}
+
+/**
+ * Une uma AVL com os ids de "grande" e outra com os de "pequeno"
+ * \return o tempo da união e o número de animais no fim
+*/
+template <typename Allocator>
+std::pair<double, std::size_t> unir(const std::vector<std::string> &grande,
+                                    const std::vector<std::string> &pequeno) {
+  Arvore<Allocator> arvore;
+  Arvore<Allocator> outra;
+  for (const std::string &id : grande) {
+    arvore.try_emplace(id);
+  }
+  for (const std::string &id : pequeno) {
+    outra.try_emplace(id);
+  }
+  auto inicio = std::chrono::steady_clock::now();
+  arvore.unite(outra);
+  return {milissegundos(inicio), arvore.size()};
+}
+
+/// \return se as duas formas salvaram o mesmo arquivo e as uniões das AVLs
+/// deram o mesmo número de animais
+bool medir(const std::vector<std::string> &grande, std::size_t m,
+           std::mt19937 &gerador) {
+  std::vector<std::string> pequeno;
+  for (std::size_t index = 0; index < m; ++index) {
+    pequeno.push_back(index % 2 == 0 ? grande[gerador() % grande.size()]
+                                     : "novo" + std::to_string(gerador()));
+  }
+  salvar(ArquivoGrande, grande);
+  salvar(ArquivoPequeno, pequeno);
+  copiar(ArquivoGrande, ArquivoUmPorUm);
+  copiar(ArquivoGrande, ArquivoMesclado);
+
+  double um_por_um;
+  double mesclado;
+  {
+    Dados dados(ArquivoUmPorUm);
+    auto inicio = std::chrono::steady_clock::now();
+    for (const std::string &id : pequeno) {
+      dados.inserir_animal(id, {});
+    }
+    um_por_um = milissegundos(inicio);
+  } // o destrutor salva os dados
+  {
+    Dados dados(ArquivoMesclado);
+    Dados outro(ArquivoPequeno);
+    auto inicio = std::chrono::steady_clock::now();
+    dados.mesclar(outro);
+    mesclado = milissegundos(inicio);
+  }
+  std::cout << grande.size() << " + " << m << " animais: " << um_por_um
+            << " ms um por um, " << mesclado << " ms com mesclar\n";
+  auto [paralela, animais] = unir<std::allocator<char>>(grande, pequeno);
+  auto [serial, animais_do_slab] =
+      unir<tree::SlabAllocator<char>>(grande, pequeno);
+  std::cout << "  uniao das AVLs: " << paralela << " ms com std::allocator, "
+            << serial << " ms com SlabAllocator\n";
+  bool iguais = ler_arquivo(ArquivoUmPorUm) == ler_arquivo(ArquivoMesclado) and
+                animais == animais_do_slab;
+  for (const char *nome :
+       {ArquivoGrande, ArquivoPequeno, ArquivoUmPorUm, ArquivoMesclado}) {
+    std::remove(nome);
+  }
+  return iguais;
+}
+
+int main(int argc, char *argv[]) {
+  std::size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+
+  std::cout << std::thread::hardware_concurrency() << " nucleos\n";
+  std::mt19937 gerador(11);
+  std::vector<std::string> grande(n);
+  for (std::string &id : grande) {
+    id = std::to_string(gerador());
+  }
+  for (std::size_t divisor : {1000, 100, 10, 1}) {
+    std::size_t m = n / divisor;
+    if (m > 0 and !medir(grande, m, gerador)) {
+      std::cout << "as unioes deveriam dar o mesmo resultado\n";
+      return EXIT_FAILURE;
+    }
+  }
+}
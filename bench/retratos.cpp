@@ -0,0 +1,80 @@
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "../src/persistent_avl.h"
+
+/**
+ * Um escritor insere n registros numa PersistentAVL e, a cada lote, publica
+ * um retrato (cópia O(1)) que outra thread salva num std::ostringstream
+ * enquanto o escritor continua inserindo. Confere que cada retrato salvo
+ * está em ordem e completo, e compara o tempo das inserções com e sem os
+ * retratos. Uso: retratos [n] [registros por retrato]
+*/
+using Arvore = PersistentAVL<std::string, std::string, std::less<>>;
+
+/// Insere os registros [0, n), publicando um retrato a cada "lote"
+double inserir(std::size_t n, std::size_t lote,
+               std::shared_ptr<const Arvore> *publicado) {
+  Arvore arvore;
+  auto inicio = std::chrono::steady_clock::now();
+  for (std::size_t index = 0; index < n; ++index) {
+    arvore.try_emplace(std::to_string(index), "monitoramento");
+    if (publicado != nullptr and index % lote == 0) {
+      std::atomic_store(publicado, std::make_shared<const Arvore>(arvore));
+    }
+  }
+  std::chrono::duration<double, std::milli> tempo =
+      std::chrono::steady_clock::now() - inicio;
+  return tempo.count();
+}
+
+int main(int argc, char *argv[]) {
+  std::size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 500000;
+  std::size_t lote = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000;
+  if (lote == 0) {
+    lote = 1;
+  }
+
+  double sem_retratos = inserir(n, lote, nullptr);
+
+  std::shared_ptr<const Arvore> publicado = std::make_shared<const Arvore>();
+  std::atomic<bool> terminou{false};
+  std::size_t salvos = 0;
+  bool consistente = true;
+  std::thread leitor([&] {
+    while (not terminou) {
+      std::shared_ptr<const Arvore> retrato = std::atomic_load(&publicado);
+      std::ostringstream arquivo;
+      std::size_t registros = 0;
+      const std::string *anterior = nullptr;
+      for (auto it = retrato->begin(); it != retrato->end(); ++it) {
+        if (anterior != nullptr and not(*anterior < it->first)) {
+          consistente = false;
+        }
+        anterior = &it->first;
+        arquivo << it->first << ',' << *it << '\n';
+        ++registros;
+      }
+      consistente = consistente and registros == retrato->size();
+      ++salvos;
+    }
+  });
+  double com_retratos = inserir(n, lote, &publicado);
+  terminou = true;
+  leitor.join();
+
+  std::cout << n << " insercoes: " << sem_retratos << " ms sem retratos, "
+            << com_retratos << " ms com um retrato a cada " << lote
+            << " (" << salvos << " retratos salvos por outra thread)\n";
+  if (!consistente) {
+    std::cout << "um retrato mudou enquanto era salvo\n";
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,356 @@
+#ifndef ANALISE_H
+#define ANALISE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "medidas.h"
+
+/**
+ * Kernels de análise sobre as colunas de ColunasDeMonitoramento: cada um
+ * percorre uma coluna de medidas e a de dias, contando só as linhas com a
+ * data dentro de uma janela e a medida conhecida (não NaN).
+ *
+ * Os kernels usam AVX2 (8 linhas por instrução) quando o compilador pode
+ * gerá-lo (-march=native numa máquina com AVX2, como nas medições), senão
+ * SSE2 (4 linhas, sempre presente em x86-64), senão as versões "_escalar",
+ * que tratam uma linha por vez e são a referência dos resultados
+*/
+
+/**
+ * Dias de "inicio" a "fim", inclusive. A janela padrão aceita qualquer dia,
+ * até os desconhecidos
+*/
+struct JanelaDeDias {
+  std::int32_t inicio = std::numeric_limits<std::int32_t>::min();
+  std::int32_t fim = std::numeric_limits<std::int32_t>::max();
+
+  bool contem(std::int32_t dia) const { return dia >= inicio and dia <= fim; }
+};
+
+/**
+ * Quantidade, soma, mínimo e máximo de um conjunto de medidas. A soma é em
+ * double para não perder precisão em milhões de linhas
+*/
+struct Agregado {
+  size_t contagem = 0;
+  double soma = 0;
+  float minimo = std::numeric_limits<float>::infinity();
+  float maximo = -std::numeric_limits<float>::infinity();
+
+  double media() const { return contagem == 0 ? 0 : soma / contagem; }
+
+  void juntar(const Agregado &outro) {
+    contagem += outro.contagem;
+    soma += outro.soma;
+    minimo = std::min(minimo, outro.minimo);
+    maximo = std::max(maximo, outro.maximo);
+  }
+};
+
+/**
+ * Contagens de medidas em "faixas" faixas de mesma largura entre "minimo",
+ * inclusive, e "maximo", exclusive. Medidas fora disso não são contadas
+*/
+struct Histograma {
+  float minimo;
+  float maximo;
+  std::vector<size_t> contagens;
+
+  Histograma(float minimo, float maximo, size_t faixas)
+      : minimo(minimo), maximo(maximo), contagens(faixas, 0) {}
+
+  /// Se há alguma faixa e o intervalo não é vazio
+  bool valido() const { return !contagens.empty() and minimo < maximo; }
+  float largura() const { return (maximo - minimo) / contagens.size(); }
+  /// Multiplicador que leva uma medida à sua faixa, o mesmo em todo kernel
+  float faixas_por_unidade() const {
+    return contagens.size() / (maximo - minimo);
+  }
+  /// Faixa de uma medida entre minimo e maximo
+  size_t faixa(float medida) const {
+    size_t indice =
+        static_cast<size_t>((medida - minimo) * faixas_por_unidade());
+    return std::min(indice, contagens.size() - 1);
+  }
+};
+
+/**
+ * Medidas de uma espécie numa janela de dias
+*/
+struct ResumoDaEspecie {
+  size_t animais = 0; // Animais da espécie com alguma medida na janela
+  Agregado temperatura;
+  Agregado peso;
+};
+
+inline Agregado agregar_escalar(const float *medidas, const std::int32_t *dias,
+                                size_t linhas, JanelaDeDias janela) {
+  Agregado agregado;
+  for (size_t linha = 0; linha < linhas; ++linha) {
+    float medida = medidas[linha];
+    if (janela.contem(dias[linha]) and medida == medida) { // NaN != NaN
+      ++agregado.contagem;
+      agregado.soma += medida;
+      agregado.minimo = std::min(agregado.minimo, medida);
+      agregado.maximo = std::max(agregado.maximo, medida);
+    }
+  }
+  return agregado;
+}
+
+/**
+ * Linhas na janela com medida maior que "limite"
+*/
+inline size_t contar_acima_escalar(const float *medidas,
+                                   const std::int32_t *dias, size_t linhas,
+                                   JanelaDeDias janela, float limite) {
+  size_t contagem = 0;
+  for (size_t linha = 0; linha < linhas; ++linha) {
+    contagem += janela.contem(dias[linha]) and medidas[linha] > limite;
+  }
+  return contagem;
+}
+
+/**
+ * Soma ao histograma as medidas das linhas na janela
+*/
+inline void acumular_histograma_escalar(const float *medidas,
+                                        const std::int32_t *dias,
+                                        size_t linhas, JanelaDeDias janela,
+                                        Histograma &histograma) {
+  if (!histograma.valido()) {
+    return;
+  }
+  for (size_t linha = 0; linha < linhas; ++linha) {
+    float medida = medidas[linha];
+    if (janela.contem(dias[linha]) and medida >= histograma.minimo and
+        medida < histograma.maximo) {
+      ++histograma.contagens[histograma.faixa(medida)];
+    }
+  }
+}
+
+#if defined(__AVX2__)
+/**
+ * Máscara das linhas [linha, linha + 8) na janela e com medida conhecida
+*/
+inline __m256 linhas_validas(const float *medidas, const std::int32_t *dias,
+                             size_t linha, __m256i inicio, __m256i fim,
+                             __m256 &valores) {
+  __m256i dia = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i *>(dias + linha));
+  __m256i fora = _mm256_or_si256(_mm256_cmpgt_epi32(inicio, dia),
+                                 _mm256_cmpgt_epi32(dia, fim));
+  valores = _mm256_loadu_ps(medidas + linha);
+  __m256 conhecidas = _mm256_cmp_ps(valores, valores, _CMP_ORD_Q);
+  return _mm256_andnot_ps(_mm256_castsi256_ps(fora), conhecidas);
+}
+#elif defined(__SSE2__)
+/**
+ * Máscara das linhas [linha, linha + 4) na janela e com medida conhecida
+*/
+inline __m128 linhas_validas(const float *medidas, const std::int32_t *dias,
+                             size_t linha, __m128i inicio, __m128i fim,
+                             __m128 &valores) {
+  __m128i dia =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(dias + linha));
+  __m128i fora = _mm_or_si128(_mm_cmpgt_epi32(inicio, dia),
+                              _mm_cmpgt_epi32(dia, fim));
+  valores = _mm_loadu_ps(medidas + linha);
+  return _mm_andnot_ps(_mm_castsi128_ps(fora), _mm_cmpord_ps(valores, valores));
+}
+/// "se_sim" onde a máscara é verdadeira, "se_nao" no resto (SSE2 não tem blendv)
+inline __m128 escolher(__m128 mascara, __m128 se_sim, __m128 se_nao) {
+  return _mm_or_ps(_mm_and_ps(mascara, se_sim), _mm_andnot_ps(mascara, se_nao));
+}
+#endif
+
+/**
+ * Contagem, soma, mínimo e máximo das medidas conhecidas das linhas na
+ * janela
+*/
+inline Agregado agregar(const float *medidas, const std::int32_t *dias,
+                        size_t linhas, JanelaDeDias janela) {
+  Agregado agregado;
+  size_t linha = 0;
+#if defined(__AVX2__)
+  const __m256i inicio = _mm256_set1_epi32(janela.inicio);
+  const __m256i fim = _mm256_set1_epi32(janela.fim);
+  const __m256 mais_infinito = _mm256_set1_ps(agregado.minimo);
+  const __m256 menos_infinito = _mm256_set1_ps(agregado.maximo);
+  __m256d soma_baixa = _mm256_setzero_pd();
+  __m256d soma_alta = _mm256_setzero_pd();
+  __m256 minimo = mais_infinito;
+  __m256 maximo = menos_infinito;
+  for (; linha + 8 <= linhas; linha += 8) {
+    __m256 valores;
+    __m256 validas = linhas_validas(medidas, dias, linha, inicio, fim, valores);
+    __m256 somadas = _mm256_and_ps(validas, valores);
+    soma_baixa = _mm256_add_pd(
+        soma_baixa, _mm256_cvtps_pd(_mm256_castps256_ps128(somadas)));
+    soma_alta = _mm256_add_pd(
+        soma_alta, _mm256_cvtps_pd(_mm256_extractf128_ps(somadas, 1)));
+    minimo = _mm256_min_ps(minimo,
+                           _mm256_blendv_ps(mais_infinito, valores, validas));
+    maximo = _mm256_max_ps(maximo,
+                           _mm256_blendv_ps(menos_infinito, valores, validas));
+    agregado.contagem += __builtin_popcount(_mm256_movemask_ps(validas));
+  }
+  alignas(32) double somas[4];
+  _mm256_store_pd(somas, _mm256_add_pd(soma_baixa, soma_alta));
+  alignas(32) float minimos[8];
+  alignas(32) float maximos[8];
+  _mm256_store_ps(minimos, minimo);
+  _mm256_store_ps(maximos, maximo);
+  agregado.soma = somas[0] + somas[1] + somas[2] + somas[3];
+  agregado.minimo = *std::min_element(minimos, minimos + 8);
+  agregado.maximo = *std::max_element(maximos, maximos + 8);
+#elif defined(__SSE2__)
+  const __m128i inicio = _mm_set1_epi32(janela.inicio);
+  const __m128i fim = _mm_set1_epi32(janela.fim);
+  const __m128 mais_infinito = _mm_set1_ps(agregado.minimo);
+  const __m128 menos_infinito = _mm_set1_ps(agregado.maximo);
+  __m128d soma_baixa = _mm_setzero_pd();
+  __m128d soma_alta = _mm_setzero_pd();
+  __m128 minimo = mais_infinito;
+  __m128 maximo = menos_infinito;
+  for (; linha + 4 <= linhas; linha += 4) {
+    __m128 valores;
+    __m128 validas = linhas_validas(medidas, dias, linha, inicio, fim, valores);
+    __m128 somadas = _mm_and_ps(validas, valores);
+    soma_baixa = _mm_add_pd(soma_baixa, _mm_cvtps_pd(somadas));
+    soma_alta =
+        _mm_add_pd(soma_alta, _mm_cvtps_pd(_mm_movehl_ps(somadas, somadas)));
+    minimo = _mm_min_ps(minimo, escolher(validas, valores, mais_infinito));
+    maximo = _mm_max_ps(maximo, escolher(validas, valores, menos_infinito));
+    agregado.contagem += __builtin_popcount(_mm_movemask_ps(validas));
+  }
+  alignas(16) double somas[2];
+  _mm_store_pd(somas, _mm_add_pd(soma_baixa, soma_alta));
+  alignas(16) float minimos[4];
+  alignas(16) float maximos[4];
+  _mm_store_ps(minimos, minimo);
+  _mm_store_ps(maximos, maximo);
+  agregado.soma = somas[0] + somas[1];
+  agregado.minimo = *std::min_element(minimos, minimos + 4);
+  agregado.maximo = *std::max_element(maximos, maximos + 4);
+#endif
+  agregado.juntar(agregar_escalar(medidas + linha, dias + linha,
+                                  linhas - linha, janela));
+  return agregado;
+}
+
+/**
+ * Linhas na janela com medida maior que "limite": o filtro de "quais
+ * animais passaram de X graus"
+*/
+inline size_t contar_acima(const float *medidas, const std::int32_t *dias,
+                           size_t linhas, JanelaDeDias janela, float limite) {
+  size_t contagem = 0;
+  size_t linha = 0;
+#if defined(__AVX2__)
+  const __m256i inicio = _mm256_set1_epi32(janela.inicio);
+  const __m256i fim = _mm256_set1_epi32(janela.fim);
+  const __m256 limites = _mm256_set1_ps(limite);
+  for (; linha + 8 <= linhas; linha += 8) {
+    __m256 valores;
+    __m256 validas = linhas_validas(medidas, dias, linha, inicio, fim, valores);
+    __m256 acima =
+        _mm256_and_ps(validas, _mm256_cmp_ps(valores, limites, _CMP_GT_OQ));
+    contagem += __builtin_popcount(_mm256_movemask_ps(acima));
+  }
+#elif defined(__SSE2__)
+  const __m128i inicio = _mm_set1_epi32(janela.inicio);
+  const __m128i fim = _mm_set1_epi32(janela.fim);
+  const __m128 limites = _mm_set1_ps(limite);
+  for (; linha + 4 <= linhas; linha += 4) {
+    __m128 valores;
+    __m128 validas = linhas_validas(medidas, dias, linha, inicio, fim, valores);
+    __m128 acima = _mm_and_ps(validas, _mm_cmpgt_ps(valores, limites));
+    contagem += __builtin_popcount(_mm_movemask_ps(acima));
+  }
+#endif
+  return contagem + contar_acima_escalar(medidas + linha, dias + linha,
+                                         linhas - linha, janela, limite);
+}
+
+/**
+ * Soma ao histograma as medidas das linhas na janela. As faixas são
+ * calculadas em vetor; os incrementos, que podem cair na mesma faixa, uma
+ * linha por vez
+*/
+inline void acumular_histograma(const float *medidas, const std::int32_t *dias,
+                                size_t linhas, JanelaDeDias janela,
+                                Histograma &histograma) {
+  if (!histograma.valido()) {
+    return;
+  }
+  size_t linha = 0;
+#if defined(__AVX2__)
+  const __m256i inicio = _mm256_set1_epi32(janela.inicio);
+  const __m256i fim = _mm256_set1_epi32(janela.fim);
+  const __m256 minimo = _mm256_set1_ps(histograma.minimo);
+  const __m256 maximo = _mm256_set1_ps(histograma.maximo);
+  const __m256 escala = _mm256_set1_ps(histograma.faixas_por_unidade());
+  const __m256i ultima =
+      _mm256_set1_epi32(static_cast<int>(histograma.contagens.size() - 1));
+  alignas(32) std::int32_t faixas[8];
+  for (; linha + 8 <= linhas; linha += 8) {
+    __m256 valores;
+    __m256 validas = linhas_validas(medidas, dias, linha, inicio, fim, valores);
+    validas = _mm256_and_ps(
+        validas, _mm256_and_ps(_mm256_cmp_ps(valores, minimo, _CMP_GE_OQ),
+                               _mm256_cmp_ps(valores, maximo, _CMP_LT_OQ)));
+    int mascara = _mm256_movemask_ps(validas);
+    if (mascara == 0) {
+      continue;
+    }
+    __m256i faixa = _mm256_cvttps_epi32(
+        _mm256_mul_ps(_mm256_sub_ps(valores, minimo), escala));
+    _mm256_store_si256(reinterpret_cast<__m256i *>(faixas),
+                       _mm256_min_epi32(faixa, ultima));
+    for (; mascara != 0; mascara &= mascara - 1) {
+      ++histograma.contagens[faixas[__builtin_ctz(mascara)]];
+    }
+  }
+#elif defined(__SSE2__)
+  const __m128i inicio = _mm_set1_epi32(janela.inicio);
+  const __m128i fim = _mm_set1_epi32(janela.fim);
+  const __m128 minimo = _mm_set1_ps(histograma.minimo);
+  const __m128 maximo = _mm_set1_ps(histograma.maximo);
+  const __m128 escala = _mm_set1_ps(histograma.faixas_por_unidade());
+  const std::int32_t ultima =
+      static_cast<std::int32_t>(histograma.contagens.size() - 1);
+  alignas(16) std::int32_t faixas[4];
+  for (; linha + 4 <= linhas; linha += 4) {
+    __m128 valores;
+    __m128 validas = linhas_validas(medidas, dias, linha, inicio, fim, valores);
+    validas = _mm_and_ps(validas, _mm_and_ps(_mm_cmpge_ps(valores, minimo),
+                                             _mm_cmplt_ps(valores, maximo)));
+    int mascara = _mm_movemask_ps(validas);
+    if (mascara == 0) {
+      continue;
+    }
+    _mm_store_si128(reinterpret_cast<__m128i *>(faixas),
+                    _mm_cvttps_epi32(
+                        _mm_mul_ps(_mm_sub_ps(valores, minimo), escala)));
+    for (; mascara != 0; mascara &= mascara - 1) {
+      ++histograma.contagens[std::min(faixas[__builtin_ctz(mascara)], ultima)];
+    }
+  }
+#endif
+  acumular_histograma_escalar(medidas + linha, dias + linha, linhas - linha,
+                              janela, histograma);
+}
+
+#endif // #ifndef ANALISE_H
@@ -1,268 +1,1376 @@
 #ifndef AVL_H
 #define AVL_H
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdlib>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <thread> // hardware_concurrency
+#include <tuple>
+#include <type_traits>
 #include <utility>
 
-template <typename KeyType, typename DataType> class AVL {
+#include "slab_allocator.h"
+#include "tree_stats.h"
+
+/**
+ * AVL tree mapping unique keys to data.
+ *
+ * The root hangs as the left child of a header node owned by the tree, which
+ * serves as end(): incrementing the last element climbs to it and
+ * decrementing it descends to the last element. begin() is cached.
+ * \tparam Compare strict weak ordering of the keys. A transparent one, such as
+ *         std::less<>, lets find, erase and contains take any type comparable
+ *         with KeyType (e.g. std::string_view for std::string keys) without
+ *         building a key.
+ * \tparam Allocator allocator rebound to allocate the nodes, e.g.
+ *         tree::SlabAllocator to keep them contiguous.
+ */
+template <typename KeyType, typename DataType,
+          typename Compare = std::less<KeyType>,
+          typename Allocator = std::allocator<std::pair<const KeyType, DataType>>>
+class AVL {
 public:
-  class iterator;
-  struct node {
-    KeyType first;
+  template <bool Const> class basic_iterator;
+  using iterator = basic_iterator<false>;
+  using const_iterator = basic_iterator<true>;
+
+  /**
+   * Links of a node; the header is only this part.
+   */
+  struct node_base {
+    int children_high_difference{0};
+    size_t subtree_size{1}; //!< Nodes in the subtree rooted here.
+    node_base *parent{nullptr};
+    node_base *right_child{nullptr};
+    node_base *left_child{nullptr};
+  };
+  struct node : node_base {
+    const KeyType first;
     DataType second;
-    int children_high_difference;
-    node *parent;
-    node *right_child;
-    node *left_child;
-
-    node(KeyType key, DataType data, int high, node *parent, node *right_child,
-         node *left_child)
-        : first(key), second(data), children_high_difference(high),
-          parent(parent), right_child(right_child), left_child(left_child) {}
+
+    /**
+     * Builds a leaf hanging from "parent", constructing the key from "key"
+     * and the data from "args" in place.
+     */
+    template <typename Key, typename... Args>
+    node(node_base *parent, Key &&key, Args &&...args)
+        : node_base{0, 1, parent, nullptr, nullptr},
+          first(std::forward<Key>(key)),
+          second(std::forward<Args>(args)...) {}
   };
 
-  void insert(const std::pair<KeyType, DataType> &data) {
-    ++m_size;
-    node *runner = m_root;
-    node *parent = nullptr;
-    while (runner != nullptr) {
-      parent = runner;
-      if (runner->first > data.first) {
-        runner = runner->left_child;
-      } else if (runner->first < data.first) {
-        runner = runner->right_child;
-      } else {
-        return; // chave ja existe
-      }
+  AVL() = default;
+  AVL(const AVL &) = delete;
+  AVL &operator=(const AVL &) = delete;
+
+  /**
+   * Inserts a copy of "data" if its key is not in the tree yet.
+   * \return iterator to the element with that key and whether it was inserted.
+   */
+  std::pair<iterator, bool> insert(const std::pair<KeyType, DataType> &data) {
+    return try_emplace(data.first, data.second);
+  }
+
+  /**
+   * Inserts "data" moving its key and data into the new node.
+   * \return iterator to the element with that key and whether it was inserted.
+   */
+  std::pair<iterator, bool> insert(std::pair<KeyType, DataType> &&data) {
+    return try_emplace(std::move(data.first), std::move(data.second));
+  }
+
+  /**
+   * Constructs a node from "key" and "args" (the arguments of the data
+   * constructor) and links it, unless the key is already in the tree.
+   * Unlike try_emplace, the node is always built, so the key may be given in
+   * any form KeyType can be constructed from.
+   * \return iterator to the element with that key and whether it was inserted.
+   */
+  template <typename Key, typename... Args>
+  std::pair<iterator, bool> emplace(Key &&key, Args &&...args) {
+    node *new_node = create_node(nullptr, std::forward<Key>(key),
+                                 std::forward<Args>(args)...);
+    auto [parent, found] = insert_position(new_node->first);
+    if (found != nullptr) {
+      destroy_node(new_node);
+      return {iterator(found), false};
+    }
+    link_node(new_node, parent);
+    return {iterator(new_node), true};
+  }
+
+  /**
+   * If "key" is not in the tree, inserts it with data constructed in place
+   * from "args"; otherwise leaves "key" and "args" untouched.
+   * \return iterator to the element with that key and whether it was inserted.
+   */
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const KeyType &key, Args &&...args) {
+    auto [parent, found] = insert_position(key);
+    if (found != nullptr) {
+      return {iterator(found), false};
+    }
+    node *new_node = create_node(parent, key, std::forward<Args>(args)...);
+    link_node(new_node, parent);
+    return {iterator(new_node), true};
+  }
+
+  /// Same as above, moving "key" into the node when it is inserted.
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(KeyType &&key, Args &&...args) {
+    auto [parent, found] = insert_position(key);
+    if (found != nullptr) {
+      return {iterator(found), false};
     }
     node *new_node =
-        new node(data.first, data.second, 0, parent, nullptr, nullptr);
-    if (parent == nullptr) { // tree empty
-      m_root = new_node;
-    } else if (data.first < parent->first) {
-      parent->left_child = new_node;
-      --(parent->children_high_difference);
-    } else {
-      parent->right_child = new_node;
-      ++(parent->children_high_difference);
-    }
-    while (parent != nullptr) {
-      if (parent->children_high_difference == 2) {
-        left_rotation(parent);
-        return;
-      } else if (parent->children_high_difference == -2) {
-        return;
-        right_rotation(parent);
-      }
-      parent = parent->parent;
-      // if (parent->left_child == nullptr and parent->right_child == nullptr) {
-      //   parent->children_high_difference = 0;
-      // } else if (parent->left_child == nullptr) {
-      //   parent->children_high_difference =
-      //       abs(parent->right_child->children_high_difference);
-      // } else if (parent->right_child == nullptr) {
-      //   parent->children_high_difference =
-      //       -abs(parent->left_child->children_high_difference);
-      // } else {
-      //   parent->children_high_difference =
-      //       abs(parent->left_child->children_high_difference) -
-      //       abs(parent->right_child->children_high_difference);
-      // }
+        create_node(parent, std::move(key), std::forward<Args>(args)...);
+    link_node(new_node, parent);
+    return {iterator(new_node), true};
+  }
+
+  /**
+   * Inserts a copy of "data" if its key is not in the tree yet, as close as
+   * possible to the position just before "hint", as std::map does. When the
+   * key belongs right before or right after "hint" no descent is made, so
+   * feeding keys in order with the previous position (or end()) as the hint
+   * skips the comparisons of a descent; the subtree sizes are still updated up
+   * to the root.
+   * \return iterator to the element with that key.
+   */
+  iterator insert(const_iterator hint,
+                  const std::pair<KeyType, DataType> &data) {
+    return try_emplace(hint, data.first, data.second);
+  }
+  /// Same as above, moving the key and the data into the new node.
+  iterator insert(const_iterator hint, std::pair<KeyType, DataType> &&data) {
+    return try_emplace(hint, std::move(data.first), std::move(data.second));
+  }
+
+  /**
+   * try_emplace starting next to "hint", see insert(hint, data).
+   * \return iterator to the element with that key.
+   */
+  template <typename... Args>
+  iterator try_emplace(const_iterator hint, const KeyType &key,
+                       Args &&...args) {
+    auto [parent, found] = insert_position(hint, key);
+    if (found != nullptr) {
+      return iterator(found);
     }
+    node *new_node = create_node(parent, key, std::forward<Args>(args)...);
+    link_node(new_node, parent);
+    return iterator(new_node);
+  }
+  /// Same as above, moving "key" into the node when it is inserted.
+  template <typename... Args>
+  iterator try_emplace(const_iterator hint, KeyType &&key, Args &&...args) {
+    auto [parent, found] = insert_position(hint, key);
+    if (found != nullptr) {
+      return iterator(found);
+    }
+    node *new_node =
+        create_node(parent, std::move(key), std::forward<Args>(args)...);
+    link_node(new_node, parent);
+    return iterator(new_node);
   }
 
   void erase(const KeyType &key) {
-    // TODO balancear a arvore
     iterator it = find(key);
-    if (it == nullptr) {
+    if (it == end()) {
       return;
     }
+    erase(it);
+  }
 
-    node *parent = &it.get_parent();
-    node *substitute = (&it)->right_child;
-    node *save = nullptr;
-    if (substitute != nullptr and substitute->left_child == nullptr) {
-      save = substitute;
-      substitute->parent = parent;
-      substitute->left_child = (&it)->left_child;
-      if ((&it)->left_child != nullptr) {
-        (&it)->left_child->parent = substitute;
-      }
-    } else if (substitute != nullptr) {
-      while (substitute->left_child != nullptr) {
-        substitute = substitute->left_child;
-      }
-      if (substitute->right_child != nullptr) {
-        substitute->right_child->parent = substitute->parent;
-        substitute->parent->left_child = substitute->right_child;
-      }
-      substitute->right_child = (&it)->right_child;
-      substitute->left_child = (&it)->left_child;
-      if ((&it)->right_child != nullptr) {
-        (&it)->right_child->parent = substitute;
-      }
-      if ((&it)->left_child != nullptr) {
-        (&it)->left_child->parent = substitute;
-      }
-      save = substitute;
-    } else if (parent == nullptr) {
-      m_root = (&it)->left_child;
-      if ((&it)->left_child != nullptr) {
-        (&it)->left_child->parent = nullptr;
-      }
-    } else if ((&it)->left_child != nullptr) {
-      save = (&it)->left_child;
-      (&it)->left_child->parent = parent;
+  /// Removes the element whose key is equivalent to "key", if any.
+  template <typename Key, typename C = Compare,
+            typename = typename C::is_transparent,
+            typename = std::enable_if_t<
+                not std::is_convertible_v<const Key &, const_iterator>>>
+  void erase(const Key &key) {
+    iterator it = find(key);
+    if (it == end()) {
+      return;
     }
+    erase(it);
+  }
 
-    if (parent != nullptr) {
-      if ((&it)->first < parent->first) {
-        parent->left_child = save;
+  /**
+   * Replaces the contents of the tree with the elements of [first, last),
+   * which must be sorted by strictly increasing key. The tree is built
+   * bottom-up in linear time with its balance factors set directly, instead
+   * of descending and rotating once per element. Pass move iterators to move
+   * the elements into the nodes.
+   */
+  template <typename ForwardIt>
+  void build_from_sorted(ForwardIt first, ForwardIt last) {
+    clear();
+    m_size = std::distance(first, last);
+    m_header.left_child = build_helper(first, m_size, &m_header).first;
+    m_begin = &m_header;
+    while (m_begin->left_child != nullptr) {
+      m_begin = m_begin->left_child;
+    }
+    m_last = m_size > 0 ? m_header.left_child : &m_header;
+    while (m_last->right_child != nullptr) {
+      m_last = m_last->right_child;
+    }
+  }
+
+  /**
+   * Removes the element pointed by "it" and rebalances the tree on the way
+   * back up from the splice point.
+   * \return iterator to the element following the removed one, or end() if it
+   *         was the last.
+   */
+  iterator erase(const_iterator it) {
+    node_base *target = const_cast<node_base *>(it.m_pointer);
+    node_base *next = successor(target);
+    if (target == m_begin) {
+      m_begin = next;
+    }
+    if (target == m_last) {
+      m_last = m_size == 1 ? &m_header : predecessor(target);
+    }
+    node_base *parent = nullptr; // no onde a altura de uma subarvore diminuiu
+    bool from_left = false;
+    if (target->left_child != nullptr and target->right_child != nullptr) {
+      // O sucessor assume a posicao e o fator de balanceamento do removido
+      node_base *substitute = next;
+      if (substitute->parent == target) {
+        parent = substitute;
       } else {
-        parent->right_child = save;
+        parent = substitute->parent;
+        from_left = true;
+        parent->left_child = substitute->right_child;
+        if (substitute->right_child != nullptr) {
+          substitute->right_child->parent = parent;
+        }
+        substitute->right_child = target->right_child;
+        substitute->right_child->parent = substitute;
       }
+      substitute->left_child = target->left_child;
+      substitute->left_child->parent = substitute;
+      substitute->children_high_difference = target->children_high_difference;
+      substitute->subtree_size = target->subtree_size;
+      replace_child(target, substitute);
+    } else {
+      parent = target->parent;
+      from_left = parent->left_child == target;
+      replace_child(target, target->left_child != nullptr
+                                ? target->left_child
+                                : target->right_child);
     }
+    destroy_node(static_cast<node *>(target));
     --m_size;
-    if (m_size == 0) {
-      m_root = nullptr;
+    for (node_base *runner = parent; runner != &m_header;
+         runner = runner->parent) {
+      --(runner->subtree_size);
     }
-    delete &it;
+    erase_fixup(parent, from_left);
+    return iterator(next);
   }
+  iterator erase(iterator it) { return erase(const_iterator(it)); }
 
-  iterator find(const KeyType &key) {
-    iterator curr = m_root;
-    while (curr != nullptr) {
-      if (curr->first > key) {
-        curr = curr->left_child;
-      } else if (curr->first < key) {
-        curr = curr->right_child;
-      } else {
-        return curr;
+  iterator find(const KeyType &key) { return iterator(find_node(key)); }
+  const_iterator find(const KeyType &key) const {
+    return const_iterator(find_node(key));
+  }
+
+  /// Looks for a key equivalent to "key", which need not be a KeyType.
+  template <typename Key, typename C = Compare,
+            typename = typename C::is_transparent>
+  iterator find(const Key &key) {
+    return iterator(find_node(key));
+  }
+  template <typename Key, typename C = Compare,
+            typename = typename C::is_transparent>
+  const_iterator find(const Key &key) const {
+    return const_iterator(find_node(key));
+  }
+
+  /**
+   * First element whose key is not less than "key", or end() if there is
+   * none.
+   */
+  iterator lower_bound(const KeyType &key) {
+    return iterator(lower_bound_node(key));
+  }
+  const_iterator lower_bound(const KeyType &key) const {
+    return const_iterator(lower_bound_node(key));
+  }
+  template <typename Key, typename C = Compare,
+            typename = typename C::is_transparent>
+  iterator lower_bound(const Key &key) {
+    return iterator(lower_bound_node(key));
+  }
+  template <typename Key, typename C = Compare,
+            typename = typename C::is_transparent>
+  const_iterator lower_bound(const Key &key) const {
+    return const_iterator(lower_bound_node(key));
+  }
+
+  /**
+   * First element whose key is greater than "key", or end() if there is
+   * none.
+   */
+  iterator upper_bound(const KeyType &key) {
+    return iterator(upper_bound_node(key));
+  }
+  const_iterator upper_bound(const KeyType &key) const {
+    return const_iterator(upper_bound_node(key));
+  }
+  template <typename Key, typename C = Compare,
+            typename = typename C::is_transparent>
+  iterator upper_bound(const Key &key) {
+    return iterator(upper_bound_node(key));
+  }
+  template <typename Key, typename C = Compare,
+            typename = typename C::is_transparent>
+  const_iterator upper_bound(const Key &key) const {
+    return const_iterator(upper_bound_node(key));
+  }
+
+  /**
+   * Elements whose key is equivalent to "key": [lower_bound, upper_bound),
+   * holding at most one element as keys are unique.
+   */
+  std::pair<iterator, iterator> equal_range(const KeyType &key) {
+    return {lower_bound(key), upper_bound(key)};
+  }
+  std::pair<const_iterator, const_iterator>
+  equal_range(const KeyType &key) const {
+    return {lower_bound(key), upper_bound(key)};
+  }
+  template <typename Key, typename C = Compare,
+            typename = typename C::is_transparent>
+  std::pair<iterator, iterator> equal_range(const Key &key) {
+    return {lower_bound(key), upper_bound(key)};
+  }
+  template <typename Key, typename C = Compare,
+            typename = typename C::is_transparent>
+  std::pair<const_iterator, const_iterator> equal_range(const Key &key) const {
+    return {lower_bound(key), upper_bound(key)};
+  }
+
+  /// Whether some key is equivalent to "key".
+  bool contains(const KeyType &key) const {
+    return insert_position(key).second != nullptr;
+  }
+
+  /// Same as above, for a key that need not be a KeyType.
+  template <typename Key, typename C = Compare,
+            typename = typename C::is_transparent>
+  bool contains(const Key &key) const {
+    return insert_position(key).second != nullptr;
+  }
+
+  iterator begin() { return iterator(m_begin); }
+  const_iterator begin() const { return const_iterator(m_begin); }
+  const_iterator cbegin() const { return begin(); }
+  /// Past-the-end iterator: the header node.
+  iterator end() { return iterator(&m_header); }
+  const_iterator end() const { return const_iterator(&m_header); }
+  const_iterator cend() const { return end(); }
+
+  bool empty() const { return m_size == 0; }
+  size_t size() const { return m_size; }
+
+  /**
+   * Height of the tree (0 when empty), found by descending through the taller
+   * child of each node.
+   */
+  size_t height() const {
+    size_t height = 0;
+    for (const node_base *runner = m_header.left_child; runner != nullptr;
+         ++height) {
+      runner = runner->children_high_difference > 0 ? runner->right_child
+                                                    : runner->left_child;
+    }
+    return height;
+  }
+
+  /**
+   * Checks every invariant in one O(n) traversal: key order, parent links,
+   * balance factors (matching the heights and within [-1, 1]), subtree sizes,
+   * size(), begin() and the cached last node. The same traversal gathers the
+   * shape of the tree, so the stats show whether it degenerated.
+   */
+  tree::TreeStats validate() const {
+    tree::TreeStats stats;
+    const node_base *previous = nullptr; // last node visited in order
+    validate_helper(m_header.left_child, &m_header, 0, stats, previous);
+    if (stats.node_count != m_size) {
+      stats.fail("size() differs from the number of nodes");
+    }
+    if (previous == nullptr and m_begin != &m_header) {
+      stats.fail("begin() of an empty tree is not end()");
+    }
+    if (m_last != (previous != nullptr ? previous : &m_header)) {
+      stats.fail("cached last node is not the rightmost one");
+    }
+    return stats;
+  }
+
+  /**
+   * Element at in-order position "index" (0 for the smallest key), found in
+   * O(log n) through the subtree sizes.
+   * \return iterator to it, or end() if "index" >= size().
+   */
+  iterator select(size_t index) { return iterator(select_node(index)); }
+  const_iterator select(size_t index) const {
+    return const_iterator(select_node(index));
+  }
+
+  /// Number of keys less than "key", i.e. its position if it is in the tree.
+  size_t rank(const KeyType &key) const { return rank_of(key); }
+
+  /// Same as above, for a key that need not be a KeyType.
+  template <typename Key, typename C = Compare,
+            typename = typename C::is_transparent,
+            typename = std::enable_if_t<
+                not std::is_convertible_v<const Key &, const_iterator>>>
+  size_t rank(const Key &key) const {
+    return rank_of(key);
+  }
+
+  /// Position of the element pointed by "it" (size() for end()).
+  size_t rank(const_iterator it) const {
+    if (it == end()) {
+      return m_size;
+    }
+    const node_base *runner = it.m_pointer;
+    size_t rank = count(runner->left_child);
+    for (; runner->parent != &m_header; runner = runner->parent) {
+      if (runner == runner->parent->right_child) {
+        rank += count(runner->parent->left_child) + 1;
       }
     }
-    return nullptr;
+    return rank;
   }
 
-  iterator begin() {
-    if (m_root == nullptr) {
-      return nullptr;
+  /**
+   * Iterators delimiting a run of consecutive elements, usable in a
+   * range-based for.
+   */
+  template <typename It> struct range {
+    It first;
+    It last;
+    It begin() const { return first; }
+    It end() const { return last; }
+  };
+
+  /**
+   * Elements of page "number" (from 0) when the tree is split in pages of
+   * "page_size" elements in key order. Both ends are found in O(log n);
+   * the last page may be shorter and pages past it are empty.
+   */
+  range<iterator> page(size_t number, size_t page_size) {
+    return {select(number * page_size), select((number + 1) * page_size)};
+  }
+  range<const_iterator> page(size_t number, size_t page_size) const {
+    return {select(number * page_size), select((number + 1) * page_size)};
+  }
+
+  /**
+   * Appends the elements of "right", whose keys must all be greater than the
+   * keys of this tree, leaving "right" empty. When the allocators compare
+   * equal the nodes of "right" are reused and the cost is O(log n); otherwise
+   * they are copied first, in O(size of "right").
+   */
+  void join(AVL &&right) {
+    subtree theirs = take_from(right);
+    adopt(join_helper(release(), theirs));
+  }
+
+  /**
+   * Moves the elements whose keys are not less than "key" to "right",
+   * replacing its contents; this tree keeps the smaller keys. The tree is cut
+   * along one root-to-leaf path, with a join per node on it, in O(log n) when
+   * the allocators compare equal; otherwise the moved elements are copied
+   * into nodes of "right".
+   */
+  template <typename Key> void split(const Key &key, AVL &right) {
+    right.clear();
+    auto [less, equal, greater] = split_helper(release(), key);
+    if (equal != nullptr) {
+      greater = join_helper(subtree(), equal, greater);
     }
-    node *curr = m_root;
-    while (curr->left_child != nullptr) {
-      curr = curr->left_child;
+    adopt(less);
+    if (m_allocator == right.m_allocator) {
+      right.adopt(greater);
+    } else {
+      right.adopt({right.clone_helper(greater.root), greater.height});
+      destroy_subtree(greater.root);
     }
-    return curr;
   }
 
-  iterator end() {
-    if (m_root == nullptr) {
-      return nullptr;
+  /**
+   * Inserts the elements of "other" whose keys are not in this tree; for
+   * keys in both, the element of this tree stays. Join-based: "other" is split
+   * by the root of this tree and the halves are united with its subtrees,
+   * recursively, in O(m log(n / m + 1)) for trees of m <= n elements. Large
+   * trees recurse on the two halves in parallel when the allocator is
+   * stateless (e.g. std::allocator); a SlabAllocator pool is not safe to
+   * share between threads. The elements of "other" are copied first, in
+   * O(m).
+   */
+  void unite(const AVL &other) {
+    subtree theirs{clone_helper(other.m_header.left_child), other.height()};
+    size_t depth = parallel_depth(m_size + other.m_size);
+    adopt(unite_helper(release(), theirs, depth));
+  }
+  /// Same as above, reusing the nodes of "other" when the allocators compare
+  /// equal, and leaving it empty.
+  void unite(AVL &&other) {
+    subtree theirs = take_from(other);
+    size_t depth = parallel_depth(m_size + theirs.count());
+    adopt(unite_helper(release(), theirs, depth));
+  }
+
+  /**
+   * Removes the elements whose keys are not in "other", which is only read:
+   * this tree is split by the root of "other" and the halves are intersected
+   * with its subtrees, recursively and, for large trees with a stateless
+   * allocator, in parallel.
+   */
+  void intersect(const AVL &other) {
+    if (&other == this) {
+      return;
     }
-    node *curr = m_root;
-    while (curr->right_child != nullptr) {
-      curr = curr->right_child;
+    size_t depth = parallel_depth(m_size + other.m_size);
+    adopt(intersect_helper(release(), other.m_header.left_child,
+                           other.height(), depth));
+  }
+
+  /**
+   * Removes the elements whose keys are in "other", which is only read, the
+   * same way as intersect.
+   */
+  void subtract(const AVL &other) {
+    if (&other == this) {
+      clear();
+      return;
     }
-    return curr;
+    size_t depth = parallel_depth(m_size + other.m_size);
+    adopt(subtract_helper(release(), other.m_header.left_child, depth));
   }
 
-  ~AVL() {
-    if (m_root == nullptr) {
+  void clear() {
+    if (m_header.left_child == nullptr) {
       return;
     }
-    clear_helper(m_root);
-    m_root = nullptr;
+    if constexpr (std::is_trivially_destructible_v<node> and
+                  tree::releases_in_bulk<node_allocator>::value) {
+      m_allocator.release(); // devolve os slabs sem visitar cada no
+    } else {
+      clear_helper(m_header.left_child);
+    }
+    m_header.left_child = nullptr;
+    m_begin = &m_header;
+    m_last = &m_header;
     m_size = 0;
   }
 
-  class iterator {
+  ~AVL() { clear(); }
+
+  /**
+   * Bidirectional iterator over the elements in key order. Dereferencing
+   * gives a reference to the data; the arrow gives the node, so "it->first"
+   * is the key and "it->second" the data.
+   * \tparam Const whether the elements are read-only through it.
+   */
+  template <bool Const> class basic_iterator {
   public:
-    iterator();
-    iterator(node *pointer) : m_pointer(pointer) {}
-    iterator &operator=(const iterator &it) { return m_pointer = it.m_pointer; }
-    iterator &operator=(node *pointer) {
-      m_pointer = pointer;
-      return *this;
-    }
-    friend bool operator==(const iterator &lhs, const iterator &rhs) {
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = DataType;
+    using difference_type = std::ptrdiff_t;
+    using pointer = std::conditional_t<Const, const node *, node *>;
+    using reference = std::conditional_t<Const, const DataType &, DataType &>;
+
+    basic_iterator() = default;
+    /// An iterator converts to a const_iterator.
+    template <bool OtherConst,
+              typename = std::enable_if_t<Const and not OtherConst>>
+    basic_iterator(const basic_iterator<OtherConst> &other)
+        : m_pointer(other.m_pointer) {}
+
+    friend bool operator==(const basic_iterator &lhs,
+                           const basic_iterator &rhs) {
       return lhs.m_pointer == rhs.m_pointer;
     }
-    friend bool operator!=(const iterator &lhs, const iterator &rhs) {
+    friend bool operator!=(const basic_iterator &lhs,
+                           const basic_iterator &rhs) {
       return !(lhs == rhs);
     }
-    DataType operator*() const { return m_pointer->second; }
-    iterator operator++() {
-      if (m_pointer->right_child != nullptr) {
-        m_pointer = m_pointer->right_child;
-        while (m_pointer->left_child != nullptr) {
-          m_pointer = m_pointer->left_child;
-        }
-      } else {
-        node *parent = m_pointer->parent;
-        node *runner = m_pointer;
-        while (parent != nullptr) {
-          if (runner == parent->left_child) {
-            m_pointer = parent;
-            break;
-          }
-          runner = runner->parent;
-          parent = runner->parent;
-        }
-      }
-      return iterator(m_pointer);
+    reference operator*() const { return operator->()->second; }
+    pointer operator->() const { return static_cast<pointer>(m_pointer); }
+    basic_iterator &operator++() {
+      m_pointer = successor(m_pointer);
+      return *this;
     }
-    iterator operator++(int) {
-      auto cp = m_pointer;
+    basic_iterator operator++(int) {
+      basic_iterator copy = *this;
       ++(*this);
-      return cp;
+      return copy;
     }
-    iterator operator--() {
-      if (m_pointer->left_child != nullptr) {
-        m_pointer = m_pointer->left_child;
-        while (m_pointer->right_child != nullptr) {
-          m_pointer = m_pointer->right_child;
-        }
-      } else {
-        node *parent = m_pointer->parent;
-        node *runner = m_pointer;
-        while (parent != nullptr) {
-          if (runner == parent->right_child) {
-            m_pointer = parent;
-            break;
-          }
-          runner = runner->parent;
-          parent = runner->parent;
-        }
-      }
-      return iterator(m_pointer);
+    basic_iterator &operator--() {
+      m_pointer = predecessor(m_pointer);
+      return *this;
     }
-    iterator operator--(int) {
-      auto cp = m_pointer;
+    basic_iterator operator--(int) {
+      basic_iterator copy = *this;
       --(*this);
-      return cp;
+      return copy;
     }
-    node *operator->() { return m_pointer; }
-    iterator get_parent() { return iterator(m_pointer->parent); }
-    node *operator&() { return m_pointer; }
 
   private:
-    node *m_pointer{nullptr};
+    friend class AVL;
+    using base_pointer =
+        std::conditional_t<Const, const node_base *, node_base *>;
+
+    explicit basic_iterator(base_pointer pointer) : m_pointer(pointer) {}
+
+    base_pointer m_pointer{nullptr};
   };
 
 private:
-  void clear_helper(node *node) {
+  using node_allocator =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<node>;
+  using node_traits = std::allocator_traits<node_allocator>;
+
+  template <typename... Args> node *create_node(Args &&...args) {
+    node *new_node = node_traits::allocate(m_allocator, 1);
+    try {
+      node_traits::construct(m_allocator, new_node,
+                             std::forward<Args>(args)...);
+    } catch (...) {
+      node_traits::deallocate(m_allocator, new_node, 1);
+      throw;
+    }
+    return new_node;
+  }
+  void destroy_node(node *old) {
+    node_traits::destroy(m_allocator, old);
+    node_traits::deallocate(m_allocator, old, 1);
+  }
+  /**
+   * Builds a subtree from the next "count" elements of "first", taking the
+   * middle one as its root; the right side gets the extra element, so the
+   * balance factor of each node is 0 or +1.
+   * \return the root of the subtree and its height.
+   */
+  template <typename ForwardIt>
+  std::pair<node_base *, size_t> build_helper(ForwardIt &first, size_t count,
+                                              node_base *parent) {
+    if (count == 0) {
+      return {nullptr, 0};
+    }
+    auto [left, left_height] = build_helper(first, (count - 1) / 2, nullptr);
+    auto &&element = *first;
+    node *root = create_node(
+        parent, std::get<0>(std::forward<decltype(element)>(element)),
+        std::get<1>(std::forward<decltype(element)>(element)));
+    ++first;
+    auto [right, right_height] = build_helper(first, count / 2, root);
+    root->left_child = left;
+    if (left != nullptr) {
+      left->parent = root;
+    }
+    root->right_child = right;
+    root->subtree_size = count;
+    root->children_high_difference =
+        static_cast<int>(right_height) - static_cast<int>(left_height);
+    return {root, right_height + 1};
+  }
+  void clear_helper(node_base *node) {
     if (node->left_child != nullptr) {
       clear_helper(node->left_child);
     }
     if (node->right_child != nullptr) {
       clear_helper(node->right_child);
     }
-    delete node;
+    destroy_node(static_cast<AVL::node *>(node));
+  }
+  void destroy_subtree(node_base *root) {
+    if (root != nullptr) {
+      clear_helper(root);
+    }
+  }
+
+  /**
+   * A detached subtree, whose root has no parent, and its height; the join
+   * algorithms need the heights, which the balance factors only give
+   * relative to the parent.
+   */
+  struct subtree {
+    node_base *root{nullptr};
+    size_t height{0};
+
+    size_t count() const { return AVL::count(root); }
+  };
+
+  /// Trees at least this large may run the set operations in parallel.
+  static constexpr size_t parallel_set_size = size_t{1} << 16;
+
+  /**
+   * Levels of recursion that may hand one half to another task when working
+   * on "elements" elements: none unless the allocator is stateless.
+   */
+  static size_t parallel_depth(size_t elements) {
+    size_t depth = 0;
+    if constexpr (node_traits::is_always_equal::value) {
+      if (elements >= parallel_set_size) {
+        for (unsigned tasks = std::thread::hardware_concurrency(); tasks > 1;
+             tasks /= 2) {
+          ++depth;
+        }
+      }
+    }
+    return depth;
+  }
+  /**
+   * Runs "left" and "right", the first one in another task while
+   * "parallel_depth" is positive.
+   */
+  template <typename Left, typename Right>
+  static void run_both(size_t parallel_depth, Left left, Right right) {
+    if (parallel_depth == 0) {
+      left();
+      right();
+      return;
+    }
+    auto left_task = std::async(std::launch::async, left);
+    try {
+      right();
+    } catch (...) {
+      left_task.wait(); // the task must finish before unwinding
+      throw;
+    }
+    left_task.get();
+  }
+
+  /// Detaches the whole tree, leaving it empty.
+  subtree release() {
+    subtree tree{m_header.left_child, height()};
+    if (tree.root != nullptr) {
+      tree.root->parent = nullptr;
+    }
+    m_header.left_child = nullptr;
+    m_begin = &m_header;
+    m_last = &m_header;
+    m_size = 0;
+    return tree;
+  }
+  /// Makes "tree" the contents of this empty tree.
+  void adopt(subtree tree) {
+    m_header.left_child = tree.root;
+    m_size = tree.count();
+    m_begin = &m_header;
+    m_last = &m_header;
+    if (tree.root == nullptr) {
+      return;
+    }
+    tree.root->parent = &m_header;
+    m_begin = tree.root;
+    while (m_begin->left_child != nullptr) {
+      m_begin = m_begin->left_child;
+    }
+    m_last = tree.root;
+    while (m_last->right_child != nullptr) {
+      m_last = m_last->right_child;
+    }
+  }
+  /**
+   * Empties "other" into a subtree of nodes from this allocator: its own
+   * nodes if the allocators compare equal, otherwise copies.
+   */
+  subtree take_from(AVL &other) {
+    if (m_allocator == other.m_allocator) {
+      return other.release();
+    }
+    subtree tree{clone_helper(other.m_header.left_child), other.height()};
+    other.clear();
+    return tree;
+  }
+  /**
+   * Copies the subtree rooted at "source" node by node, keeping its shape.
+   * If a copy throws, the nodes copied so far are destroyed.
+   * \return the root of the copy, with no parent.
+   */
+  node_base *clone_helper(const node_base *source) {
+    if (source == nullptr) {
+      return nullptr;
+    }
+    node_base *left = clone_helper(source->left_child);
+    node *root = nullptr;
+    try {
+      const node *original = static_cast<const node *>(source);
+      root = create_node(nullptr, original->first, original->second);
+      root->right_child = clone_helper(source->right_child);
+    } catch (...) {
+      destroy_subtree(left);
+      if (root != nullptr) {
+        destroy_node(root);
+      }
+      throw;
+    }
+    root->left_child = left;
+    if (left != nullptr) {
+      left->parent = root;
+    }
+    if (root->right_child != nullptr) {
+      root->right_child->parent = root;
+    }
+    root->children_high_difference = source->children_high_difference;
+    root->subtree_size = source->subtree_size;
+    return root;
+  }
+
+  /// Height of the left subtree of "root", whose height is "height".
+  static size_t left_height(const node_base *root, size_t height) {
+    return root->children_high_difference > 0 ? height - 2 : height - 1;
+  }
+  static size_t right_height(const node_base *root, size_t height) {
+    return root->children_high_difference < 0 ? height - 2 : height - 1;
+  }
+  /// Detaches the children of the root of "tree", leaving it a lone node.
+  static std::pair<subtree, subtree> detach_children(subtree tree) {
+    node_base *root = tree.root;
+    subtree left{root->left_child, left_height(root, tree.height)};
+    subtree right{root->right_child, right_height(root, tree.height)};
+    for (node_base *child : {left.root, right.root}) {
+      if (child != nullptr) {
+        child->parent = nullptr;
+      }
+    }
+    *root = node_base{0, 1, nullptr, nullptr, nullptr};
+    return {left, right};
+  }
+  static const KeyType &key_of(const node_base *target) {
+    return static_cast<const node *>(target)->first;
+  }
+
+  /**
+   * Joins "left", the lone node "middle" and "right", whose keys are in this
+   * order. If the heights differ by more than one, "middle" is hung on the
+   * inner spine of the taller tree next to a subtree as tall as the other
+   * tree, and the tree is rebalanced on the way up as after an insertion, in
+   * O(difference of heights + 1).
+   */
+  subtree join_helper(subtree left, node_base *middle, subtree right) {
+    if (left.height > right.height + 1) {
+      return join_spine(left, middle, right, true);
+    }
+    if (right.height > left.height + 1) {
+      return join_spine(right, middle, left, false);
+    }
+    middle->left_child = left.root;
+    middle->right_child = right.root;
+    for (node_base *child : {left.root, right.root}) {
+      if (child != nullptr) {
+        child->parent = middle;
+      }
+    }
+    middle->children_high_difference =
+        static_cast<int>(right.height) - static_cast<int>(left.height);
+    middle->subtree_size = left.count() + right.count() + 1;
+    return {middle, std::max(left.height, right.height) + 1};
+  }
+  /**
+   * join_helper when "tall" (on the left if "tall_on_left") is more than one
+   * level taller than "short_tree".
+   */
+  subtree join_spine(subtree tall, node_base *middle, subtree short_tree,
+                     bool tall_on_left) {
+    node_base top; // parent of the root while rebalancing
+    top.left_child = tall.root;
+    tall.root->parent = &top;
+    node_base *parent = &top;
+    node_base *runner = tall.root;
+    size_t height = tall.height;
+    size_t added = short_tree.count() + 1;
+    while (height > short_tree.height + 1) {
+      int toward = tall_on_left ? runner->children_high_difference
+                                : -runner->children_high_difference;
+      height -= toward >= 0 ? 1 : 2;
+      runner->subtree_size += added;
+      parent = runner;
+      runner = tall_on_left ? runner->right_child : runner->left_child;
+    }
+    // "middle" takes the place of "runner", which is as tall as the short
+    // tree or one level taller, with it and the short tree as children
+    int difference = static_cast<int>(short_tree.height) -
+                     static_cast<int>(height);
+    if (tall_on_left) {
+      middle->left_child = runner;
+      middle->right_child = short_tree.root;
+      middle->children_high_difference = difference;
+      parent->right_child = middle;
+    } else {
+      middle->left_child = short_tree.root;
+      middle->right_child = runner;
+      middle->children_high_difference = -difference;
+      parent->left_child = middle;
+    }
+    for (node_base *child : {runner, short_tree.root}) {
+      if (child != nullptr) {
+        child->parent = middle;
+      }
+    }
+    middle->parent = parent;
+    middle->subtree_size = count(runner) + added;
+    bool grew = insert_fixup(middle, &top);
+    node_base *root = top.left_child;
+    root->parent = nullptr;
+    return {root, tall.height + (grew ? 1 : 0)};
+  }
+  /// Joins "left" and "right", whose keys are in this order.
+  subtree join_helper(subtree left, subtree right) {
+    if (left.root == nullptr) {
+      return right;
+    }
+    auto [rest, last] = split_last(left);
+    return join_helper(rest, last, right);
+  }
+  /// Detaches the last node of "tree", returning the rest and that node.
+  std::pair<subtree, node_base *> split_last(subtree tree) {
+    node_base *root = tree.root;
+    auto [left, right] = detach_children(tree);
+    if (right.root == nullptr) {
+      return {left, root};
+    }
+    auto [rest, last] = split_last(right);
+    return {join_helper(left, root, rest), last};
+  }
+  /**
+   * Splits "tree" into the keys less than "key", the node with an equivalent
+   * key (or nullptr) and the greater keys, joining the pieces cut from the
+   * path followed by a search for "key".
+   */
+  template <typename Key>
+  std::tuple<subtree, node_base *, subtree> split_helper(subtree tree,
+                                                         const Key &key) {
+    if (tree.root == nullptr) {
+      return {subtree(), nullptr, subtree()};
+    }
+    node_base *root = tree.root;
+    auto [left, right] = detach_children(tree);
+    if (m_compare(key, key_of(root))) {
+      auto [less, equal, greater] = split_helper(left, key);
+      return {less, equal, join_helper(greater, root, right)};
+    }
+    if (m_compare(key_of(root), key)) {
+      auto [less, equal, greater] = split_helper(right, key);
+      return {join_helper(left, root, less), equal, greater};
+    }
+    return {left, root, right};
+  }
+
+  /**
+   * Union of "mine" and "theirs", both made of nodes from this allocator;
+   * the nodes of "theirs" with keys in "mine" are destroyed.
+   */
+  subtree unite_helper(subtree mine, subtree theirs, size_t parallel_depth) {
+    size_t deeper = parallel_depth == 0 ? 0 : parallel_depth - 1;
+    if (theirs.root == nullptr) {
+      return mine;
+    }
+    if (mine.root == nullptr) {
+      return theirs;
+    }
+    node_base *root = mine.root;
+    auto [left, right] = detach_children(mine);
+    auto [less, equal, greater] = split_helper(theirs, key_of(root));
+    if (equal != nullptr) {
+      destroy_node(static_cast<node *>(equal));
+    }
+    run_both(
+        parallel_depth,
+        [&, &left = left, &less = less] {
+          left = unite_helper(left, less, deeper);
+        },
+        [&, &right = right, &greater = greater] {
+          right = unite_helper(right, greater, deeper);
+        });
+    return join_helper(left, root, right);
+  }
+  /**
+   * Keeps the nodes of "mine" whose keys are in the subtree "theirs", of
+   * height "height", destroying the others.
+   */
+  subtree intersect_helper(subtree mine, const node_base *theirs,
+                           size_t height, size_t parallel_depth) {
+    size_t deeper = parallel_depth == 0 ? 0 : parallel_depth - 1;
+    if (mine.root == nullptr) {
+      return mine;
+    }
+    if (theirs == nullptr) {
+      destroy_subtree(mine.root);
+      return subtree();
+    }
+    auto [less, equal, greater] = split_helper(mine, key_of(theirs));
+    run_both(
+        parallel_depth,
+        [&, &less = less] {
+          less = intersect_helper(less, theirs->left_child,
+                                  left_height(theirs, height),
+                                  deeper);
+        },
+        [&, &greater = greater] {
+          greater = intersect_helper(greater, theirs->right_child,
+                                     right_height(theirs, height),
+                                     deeper);
+        });
+    if (equal != nullptr) {
+      return join_helper(less, equal, greater);
+    }
+    return join_helper(less, greater);
+  }
+  /// Destroys the nodes of "mine" whose keys are in the subtree "theirs".
+  subtree subtract_helper(subtree mine, const node_base *theirs,
+                          size_t parallel_depth) {
+    size_t deeper = parallel_depth == 0 ? 0 : parallel_depth - 1;
+    if (mine.root == nullptr or theirs == nullptr) {
+      return mine;
+    }
+    auto [less, equal, greater] = split_helper(mine, key_of(theirs));
+    if (equal != nullptr) {
+      destroy_node(static_cast<node *>(equal));
+    }
+    run_both(
+        parallel_depth,
+        [&, &less = less] {
+          less = subtract_helper(less, theirs->left_child, deeper);
+        },
+        [&, &greater = greater] {
+          greater =
+              subtract_helper(greater, theirs->right_child, deeper);
+        });
+    return join_helper(less, greater);
+  }
+  /**
+   * Checks the subtree rooted at "root", at "depth" and hanging from
+   * "parent", visiting it in order after "previous".
+   * \return its height.
+   */
+  size_t validate_helper(const node_base *root, const node_base *parent,
+                         size_t depth, tree::TreeStats &stats,
+                         const node_base *&previous) const {
+    if (root == nullptr) {
+      return 0;
+    }
+    stats.count_node(depth);
+    if (root->parent != parent) {
+      stats.fail("wrong parent link");
+    }
+    size_t left_height =
+        validate_helper(root->left_child, root, depth + 1, stats, previous);
+    if (previous == nullptr and root != m_begin) {
+      stats.fail("begin() is not the leftmost node");
+    }
+    if (previous != nullptr and
+        not m_compare(static_cast<const node *>(previous)->first,
+                      static_cast<const node *>(root)->first)) {
+      stats.fail("keys out of order");
+    }
+    previous = root;
+    size_t right_height =
+        validate_helper(root->right_child, root, depth + 1, stats, previous);
+    int difference =
+        static_cast<int>(right_height) - static_cast<int>(left_height);
+    if (root->children_high_difference != difference) {
+      stats.fail("balance factor does not match the subtree heights");
+    }
+    if (difference < -1 or difference > 1) {
+      stats.fail("subtree heights differ by more than one");
+    }
+    if (root->subtree_size !=
+        count(root->left_child) + count(root->right_child) + 1) {
+      stats.fail("wrong subtree size");
+    }
+    return std::max(left_height, right_height) + 1;
+  }
+  /// Number of nodes in the subtree rooted at "root" (0 for nullptr).
+  static size_t count(const node_base *root) {
+    return root != nullptr ? root->subtree_size : 0;
+  }
+  /// Node at in-order position "index", or the header if there is none.
+  node_base *select_node(size_t index) const {
+    if (index >= m_size) {
+      return header();
+    }
+    node_base *runner = m_header.left_child;
+    while (count(runner->left_child) != index) {
+      if (index < count(runner->left_child)) {
+        runner = runner->left_child;
+      } else {
+        index -= count(runner->left_child) + 1;
+        runner = runner->right_child;
+      }
+    }
+    return runner;
+  }
+  /// Number of keys less than "key".
+  template <typename Key> size_t rank_of(const Key &key) const {
+    size_t rank = 0;
+    for (const node_base *runner = m_header.left_child; runner != nullptr;) {
+      if (m_compare(static_cast<const node *>(runner)->first, key)) {
+        rank += count(runner->left_child) + 1;
+        runner = runner->right_child;
+      } else {
+        runner = runner->left_child;
+      }
+    }
+    return rank;
+  }
+  /// The header, also reachable from const members.
+  node_base *header() const { return const_cast<node_base *>(&m_header); }
+  /**
+   * Descends looking for "key".
+   * \return the node the key would hang from (the header for an empty tree)
+   *         and the node holding the key, or nullptr if there is none.
+   */
+  template <typename Key>
+  std::pair<node_base *, node_base *> insert_position(const Key &key) const {
+    node_base *runner = m_header.left_child;
+    node_base *parent = header();
+    while (runner != nullptr) {
+      if (m_compare(key, static_cast<node *>(runner)->first)) {
+        parent = runner;
+        runner = runner->left_child;
+      } else if (m_compare(static_cast<node *>(runner)->first, key)) {
+        parent = runner;
+        runner = runner->right_child;
+      } else {
+        return {parent, runner}; // chave ja existe
+      }
+    }
+    return {parent, nullptr};
+  }
+  /**
+   * Same as above, but first checks whether "key" belongs right before
+   * "hint" or right after it, where a leaf slot is always free; only
+   * otherwise descends from the root.
+   */
+  template <typename Key>
+  std::pair<node_base *, node_base *> insert_position(const_iterator hint,
+                                                      const Key &key) const {
+    node_base *position = const_cast<node_base *>(hint.m_pointer);
+    if (position == &m_header) {
+      if (m_size > 0 and
+          m_compare(static_cast<node *>(m_last)->first, key)) {
+        return {m_last, nullptr}; // depois do ultimo
+      }
+    } else if (m_compare(key, static_cast<node *>(position)->first)) {
+      if (position == m_begin) {
+        return {position, nullptr}; // antes do primeiro
+      }
+      node_base *before = predecessor(position);
+      if (m_compare(static_cast<node *>(before)->first, key)) {
+        return {before->right_child == nullptr ? before : position, nullptr};
+      }
+    } else if (m_compare(static_cast<node *>(position)->first, key)) {
+      if (position == m_last) {
+        return {position, nullptr}; // depois do ultimo
+      }
+      node_base *after = successor(position);
+      if (m_compare(key, static_cast<node *>(after)->first)) {
+        return {position->right_child == nullptr ? position : after, nullptr};
+      }
+    } else {
+      return {position->parent, position}; // chave ja existe
+    }
+    return insert_position(key);
+  }
+  /// First node whose key is not less than "key", or the header.
+  template <typename Key> node_base *lower_bound_node(const Key &key) const {
+    node_base *candidate = header();
+    for (node_base *runner = m_header.left_child; runner != nullptr;) {
+      if (m_compare(static_cast<node *>(runner)->first, key)) {
+        runner = runner->right_child;
+      } else {
+        candidate = runner;
+        runner = runner->left_child;
+      }
+    }
+    return candidate;
+  }
+  /// First node whose key is greater than "key", or the header.
+  template <typename Key> node_base *upper_bound_node(const Key &key) const {
+    node_base *candidate = header();
+    for (node_base *runner = m_header.left_child; runner != nullptr;) {
+      if (m_compare(key, static_cast<node *>(runner)->first)) {
+        candidate = runner;
+        runner = runner->left_child;
+      } else {
+        runner = runner->right_child;
+      }
+    }
+    return candidate;
+  }
+  /// Node holding "key", or the header if there is none.
+  template <typename Key> node_base *find_node(const Key &key) const {
+    node_base *found = insert_position(key).second;
+    return found != nullptr ? found : header();
+  }
+  /**
+   * Hangs the leaf "new_node" from "parent" (the header for the root) and
+   * rebalances.
+   */
+  void link_node(node *new_node, node_base *parent) {
+    ++m_size;
+    new_node->parent = parent;
+    if (parent == &m_header or
+        m_compare(new_node->first, static_cast<node *>(parent)->first)) {
+      parent->left_child = new_node;
+      if (parent == m_begin) {
+        m_begin = new_node;
+      }
+      if (parent == &m_header) {
+        m_last = new_node;
+      }
+    } else {
+      parent->right_child = new_node;
+      if (parent == m_last) {
+        m_last = new_node;
+      }
+    }
+    for (node_base *runner = parent; runner != &m_header;
+         runner = runner->parent) {
+      ++(runner->subtree_size);
+    }
+    insert_fixup(new_node, &m_header);
+  }
+  /**
+   * Returns the in-order successor of "current"; the header follows the last
+   * node, as the root is its left child.
+   */
+  template <typename Base> static Base *successor(Base *current) {
+    if (current->right_child != nullptr) {
+      current = current->right_child;
+      while (current->left_child != nullptr) {
+        current = current->left_child;
+      }
+      return current;
+    }
+    while (current == current->parent->right_child) {
+      current = current->parent;
+    }
+    return current->parent;
+  }
+  /**
+   * Returns the in-order predecessor of "current"; from the header, this is
+   * the last node.
+   */
+  template <typename Base> static Base *predecessor(Base *current) {
+    if (current->left_child != nullptr) {
+      current = current->left_child;
+      while (current->right_child != nullptr) {
+        current = current->right_child;
+      }
+      return current;
+    }
+    while (current == current->parent->left_child) {
+      current = current->parent;
+    }
+    return current->parent;
+  }
+  /**
+   * Puts "substitute" (possibly nullptr) where "old" hangs from its parent.
+   */
+  void replace_child(node_base *old, node_base *substitute) {
+    if (old == old->parent->left_child) {
+      old->parent->left_child = substitute;
+    } else {
+      old->parent->right_child = substitute;
+    }
+    if (substitute != nullptr) {
+      substitute->parent = old->parent;
+    }
+  }
+  /**
+   * Walks up from "child", whose subtree just grew one level taller (a fresh
+   * leaf, or a join), to "top", updating the balance factors (height of the
+   * right subtree minus height of the left one). Stops as soon as a subtree
+   * keeps its height; after an insertion that is at the first rotation.
+   * \return whether the subtree hanging from "top" grew.
+   */
+  bool insert_fixup(node_base *child, const node_base *top) {
+    node_base *parent = child->parent;
+    while (parent != top) {
+      if (child == parent->left_child) {
+        --(parent->children_high_difference);
+      } else {
+        ++(parent->children_high_difference);
+      }
+      if (parent->children_high_difference == 0) {
+        return false; // altura da subarvore nao mudou
+      }
+      if (parent->children_high_difference == 2 or
+          parent->children_high_difference == -2) {
+        parent = rebalance(parent);
+        if (parent->children_high_difference == 0) {
+          return false; // a rotacao restaura a altura anterior
+        }
+        // Num join, o filho pode estar balanceado: a rotacao simples deixa a
+        // subarvore um nivel mais alta, e a subida continua
+      }
+      child = parent;
+      parent = parent->parent;
+    }
+    return true;
+  }
+  /**
+   * Walks up from "parent", whose left (or right, if "from_left" is false)
+   * subtree just got shorter, rotating until some subtree keeps its height.
+   */
+  void erase_fixup(node_base *parent, bool from_left) {
+    while (parent != &m_header) {
+      if (from_left) {
+        ++(parent->children_high_difference);
+      } else {
+        --(parent->children_high_difference);
+      }
+      if (parent->children_high_difference == 1 or
+          parent->children_high_difference == -1) {
+        return; // altura da subarvore nao mudou
+      }
+      if (parent->children_high_difference != 0) {
+        parent = rebalance(parent);
+        if (parent->children_high_difference != 0) {
+          return; // rotacao simples com filho balanceado mantem a altura
+        }
+      }
+      node_base *child = parent;
+      parent = parent->parent;
+      from_left = parent->left_child == child;
+    }
+  }
+  /**
+   * Fixes a node whose balance factor is +2 or -2 with a single (RR/LL) or
+   * double (RL/LR) rotation.
+   * \return the new root of the subtree.
+   */
+  node_base *rebalance(node_base *root) {
+    if (root->children_high_difference > 0) {
+      if (root->right_child->children_high_difference < 0) {
+        right_rotation(root->right_child);
+      }
+      return left_rotation(root);
+    }
+    if (root->left_child->children_high_difference > 0) {
+      left_rotation(root->left_child);
+    }
+    return right_rotation(root);
   }
-  void left_rotation(node *root) {
-    node *new_root = root->right_child;
-    if (root == m_root) {
-      m_root = new_root;
-    } else if (root == root->parent->left_child) {
+  node_base *left_rotation(node_base *root) {
+    node_base *new_root = root->right_child;
+    if (root == root->parent->left_child) {
       root->parent->left_child = new_root;
     } else {
       root->parent->right_child = new_root;
@@ -274,12 +1382,17 @@ private:
     if (root->right_child != nullptr) {
       root->right_child->parent = root;
     }
+    root->children_high_difference -=
+        1 + std::max(new_root->children_high_difference, 0);
+    new_root->children_high_difference -=
+        1 - std::min(root->children_high_difference, 0);
+    new_root->subtree_size = root->subtree_size;
+    root->subtree_size = count(root->left_child) + count(root->right_child) + 1;
+    return new_root;
   }
-  void right_rotation(node *root) {
-    node *new_root = root->left_child;
-    if (root == m_root) {
-      m_root = new_root;
-    } else if (root == root->parent->left_child) {
+  node_base *right_rotation(node_base *root) {
+    node_base *new_root = root->left_child;
+    if (root == root->parent->left_child) {
       root->parent->left_child = new_root;
     } else {
       root->parent->right_child = new_root;
@@ -291,10 +1404,21 @@ private:
     if (root->left_child != nullptr) {
       root->left_child->parent = root;
     }
+    root->children_high_difference +=
+        1 - std::min(new_root->children_high_difference, 0);
+    new_root->children_high_difference +=
+        1 + std::max(root->children_high_difference, 0);
+    new_root->subtree_size = root->subtree_size;
+    root->subtree_size = count(root->left_child) + count(root->right_child) + 1;
+    return new_root;
   }
 
   size_t m_size{0};
-  node *m_root{nullptr};
+  node_base m_header;             //!< Parent of the root and end() sentinel.
+  node_base *m_begin{&m_header};  //!< Leftmost node, or the header if empty.
+  node_base *m_last{&m_header};   //!< Rightmost node, or the header if empty.
+  node_allocator m_allocator;
+  Compare m_compare;
 };
 
 #endif // #ifndef AVL_H
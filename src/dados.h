@@ -1,12 +1,33 @@
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
+#include <deque>
+#include <functional>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "analise.h"
 #include "avl.h"
+#include "medidas.h"
+#include "red_black_tree_map.h"
+#include "sharded_tree.h"
 
 const static int NumeroDeDadosDeMonitoramento = 6;
 const static std::string
@@ -23,41 +44,248 @@ const static std::string ordem_dos_dados_do_animal[NumeroDeDadosDoAnimal] = {
     "Data de nascimento",
 };
 
+/**
+ * Campos do animal, na ordem de ordem_dos_dados_do_animal: o índice de cada
+ * um é uma constante, então registro[EsquemaDoAnimal::Especie] não procura
+ * nada
+*/
+struct EsquemaDoAnimal {
+  enum Campo : size_t {
+    Apelido,
+    PrimeiroDiaDeMonitoramento,
+    Especie,
+    Sexo,
+    DataDeNascimento,
+    NumeroDeCampos
+  };
+  static constexpr const std::string *nomes = ordem_dos_dados_do_animal;
+};
+static_assert(EsquemaDoAnimal::NumeroDeCampos == NumeroDeDadosDoAnimal);
+
+/**
+ * Campos de um monitoramento, na ordem de ordem_dos_dados_de_monitoramento
+*/
+struct EsquemaDeMonitoramento {
+  enum Campo : size_t {
+    DataDaAvaliacao,
+    Temperatura,
+    Peso,
+    Altura,
+    SangueFoiColetado,
+    ExameFisico,
+    NumeroDeCampos
+  };
+  static constexpr const std::string *nomes = ordem_dos_dados_de_monitoramento;
+};
+static_assert(EsquemaDeMonitoramento::NumeroDeCampos ==
+              NumeroDeDadosDeMonitoramento);
+
+/**
+ * Valores texto dos campos de "Esquema", guardados em sequência no próprio
+ * registro: sem tabela hash nem uma chave alocada por campo, e cada campo é
+ * acessado pelo seu índice
+*/
+template <typename Esquema> struct RegistroDeCampos {
+  using Campo = typename Esquema::Campo;
+  static constexpr size_t numero_de_campos = Esquema::NumeroDeCampos;
+
+  std::array<std::string, numero_de_campos> valores;
+
+  std::string &operator[](Campo campo) { return valores[campo]; }
+  const std::string &operator[](Campo campo) const { return valores[campo]; }
+
+  /**
+   * Chama funcao(nome, valor) para cada campo, na ordem do esquema
+  */
+  template <typename Funcao> void para_cada_campo(Funcao funcao) {
+    for (size_t indice = 0; indice < numero_de_campos; ++indice) {
+      funcao(Esquema::nomes[indice], valores[indice]);
+    }
+  }
+  template <typename Funcao> void para_cada_campo(Funcao funcao) const {
+    for (size_t indice = 0; indice < numero_de_campos; ++indice) {
+      funcao(Esquema::nomes[indice], valores[indice]);
+    }
+  }
+};
+
+/**
+ * Índices secundários dos animais, declarados na construção dos dados. Cada
+ * índice é mantido em toda inserção e remoção, então só os declarados custam
+ * memória e tempo. Os campos "por_valor" (como Espécie e Sexo) ganham um
+ * índice hash do texto para os ids, para buscas por igualdade; os campos
+ * "por_data" (como Primeiro dia de monitoramento), um índice ordenado por
+ * dia, para buscas por intervalo de datas. Com "avaliacoes_por_data", as
+ * avaliações de todos os animais entram num índice ordenado por dia e id,
+ * para buscas por intervalo de datas em todo o rebanho
+*/
+struct IndicesDoAnimal {
+  std::vector<EsquemaDoAnimal::Campo> por_valor;
+  std::vector<EsquemaDoAnimal::Campo> por_data;
+  bool avaliacoes_por_data = false;
+};
+
+/**
+ * Como um id é lido do texto (arquivo ou usuário) e que tipo se usa para
+ * buscá-lo na árvore. O texto é escrito de volta com operator<<
+*/
+template <typename IdType> struct FormatoDoId;
+
+/**
+ * Ids texto, guardados como foram lidos e comparados em ordem lexicográfica
+*/
+template <> struct FormatoDoId<std::string> {
+  using Busca = std::string_view; // busca sem construir uma std::string
+
+  static bool ler(std::string_view texto, std::string &id) {
+    id = texto;
+    return true;
+  }
+};
+
+/**
+ * Ids numéricos, comparados como números ("2" < "12") e guardados no próprio
+ * nó, sem alocação
+*/
+template <> struct FormatoDoId<std::uint64_t> {
+  using Busca = std::uint64_t;
+
+  /**
+   * Aceita só texto formado por dígitos que caiba em 64 bits, sem zeros à
+   * esquerda: assim o id é escrito de volta com o mesmo texto, e "0" e "00"
+   * não viram o mesmo id
+  */
+  static bool ler(std::string_view texto, std::uint64_t &id) {
+    if (texto.size() > 1 and texto[0] == '0') {
+      return false;
+    }
+    const char *fim = texto.data() + texto.size();
+    auto [ultimo, erro] = std::from_chars(texto.data(), fim, id);
+    return erro == std::errc() and ultimo == fim;
+  }
+};
+
+/**
+ * Guarda os animais numa AVL: menos altura, buscas mais rápidas, e tem
+ * páginas, posições e a união por splits e joins de mesclar
+*/
+struct ArmazenamentoAVL {
+  // std::less<> permite buscar ids texto com std::string_view
+  template <typename Id, typename Dado>
+  using arvore = AVL<Id, Dado, std::less<>>;
+  static constexpr size_t numero_de_fragmentos = 1;
+  static constexpr bool tem_uniao = true;
+};
+
+/**
+ * Guarda os animais numa árvore rubro-negra, com os dados no próprio nó: no
+ * máximo duas rotações por inserção, para cargas com muitas escritas. Não tem
+ * páginas, posições nem mesclar
+*/
+struct ArmazenamentoRubroNegro {
+  template <typename Id, typename Dado>
+  using arvore = tree::RedBlackTreeMap<Id, Dado, std::less<>>;
+  static constexpr size_t numero_de_fragmentos = 1;
+  static constexpr bool tem_uniao = false;
+};
+
+/**
+ * Reparte os animais pelo hash do id entre "NumeroDeFragmentos" árvores
+ * independentes do tipo de "Base", cada uma com sua trava: inserções e
+ * remoções em fragmentos diferentes rodam ao mesmo tempo, e os lotes são
+ * aplicados em paralelo, um fragmento por thread. As listagens continuam em
+ * ordem de id, intercalando os fragmentos. Não tem páginas nem posições, e
+ * mesclar só com fragmentos AVL
+*/
+template <size_t NumeroDeFragmentos, typename Base = ArmazenamentoAVL>
+struct ArmazenamentoFragmentado {
+  template <typename Id, typename Dado>
+  using arvore =
+      tree::ShardedTree<typename Base::template arvore<Id, Dado>,
+                        NumeroDeFragmentos,
+                        std::hash<typename FormatoDoId<Id>::Busca>>;
+  static constexpr size_t numero_de_fragmentos = NumeroDeFragmentos;
+  static constexpr bool tem_uniao = Base::tem_uniao;
+};
+
+/**
+ * Uma thread por vez usa os dados: as travas não fazem nada e não custam nada
+*/
+struct AcessoDeUmaThread {
+  struct trava {
+    void lock() {}
+    void unlock() {}
+    void lock_shared() {}
+    void unlock_shared() {}
+  };
+  static constexpr size_t numero_de_travas_dos_animais = 1;
+};
+
+/**
+ * Várias threads usam os dados. Buscas, consultas e varreduras só leem e
+ * rodam em paralelo, com a árvore travada para leitura. Inserir um
+ * monitoramento não muda a árvore, então trava só o animal, por uma das
+ * travas dos animais (escolhida pelo hash do id), e roda junto com as leituras
+ * dos outros animais. Inserir e remover animais mudam a árvore e a travam
+ * sozinhos
+*/
+struct AcessoConcorrente {
+  using trava = std::shared_mutex;
+  static constexpr size_t numero_de_travas_dos_animais = 64;
+};
+
 /**
  * Class that contains
+ * \tparam Id tipo do id dos animais, std::string ou std::uint64_t
+ * \tparam Armazenamento árvore que guarda os animais, ArmazenamentoAVL ou
+ *         ArmazenamentoRubroNegro
+ * \tparam Acesso AcessoDeUmaThread ou AcessoConcorrente. Travas são sempre
+ *         tomadas na ordem árvore, depois animal
 */
-class Dados {
+template <typename Id, typename Armazenamento = ArmazenamentoAVL,
+          typename Acesso = AcessoDeUmaThread>
+class BasicDados {
 public:
   /**
-   * IdType = string
+   * Tipo do id guardado na árvore
   */
-  using IdType = std::string;
+  using IdType = Id;
+  /**
+   * Tipo aceito pelas buscas: std::string_view para ids texto
+  */
+  using IdBusca = typename FormatoDoId<IdType>::Busca;
+
+  /**
+   * Converte o texto de um id, retornando false se ele não for válido
+  */
+  static bool ler_id(std::string_view texto, IdType &id) {
+    return FormatoDoId<IdType>::ler(texto, id);
+  }
 
   /**
    * Dados do monitoramento do animal
   */
   struct DadosDeMonitoramento {
-    std::unordered_map<std::string, std::string> dados; // Armazena pares de chave-valor onde tanto a chave como o valor são strings
+    RegistroDeCampos<EsquemaDeMonitoramento> dados; // Um texto por campo, na ordem de ordem_dos_dados_de_monitoramento
 
     /**
      * Leia os valores que o usuário der para cada dado de monitoramento
     */
     void leia_valores() {
-      for (const std::string &dado : ordem_dos_dados_de_monitoramento) {
+      dados.para_cada_campo([](const std::string &dado, std::string &valor) {
         std::cout << dado << ": ";
-        std::string entrada;
-        std::getline(std::cin, entrada);
-        dados[dado] = entrada;
-      }
+        std::getline(std::cin, valor);
+      });
     }
 
     /**
      * Printe os valores dos dados de monitoramento
     */
-    void printar_valores() {
-      for (const std::string &dado : ordem_dos_dados_de_monitoramento) {
-        std::cout << "\t" << dado << ": " << dados[dado] << '\n';
-      }
+    void printar_valores() const {
+      dados.para_cada_campo(
+          [](const std::string &dado, const std::string &valor) {
+            std::cout << "\t" << dado << ": " << valor << '\n';
+          });
     }
   };
 
@@ -65,29 +293,58 @@ public:
    * Dados do animal e do monitoramento do animal
   */
   struct DadosDoAnimal {
-    std::unordered_map<std::string, std::string> dados; // Armazena pares de chave-valor onde tanto a chave como o valor são strings
+    RegistroDeCampos<EsquemaDoAnimal> dados; // Um texto por campo, na ordem de ordem_dos_dados_do_animal
     std::vector<DadosDeMonitoramento> monitoramento;  // Vetor de dados de monitorametno
+    ColunasDeMonitoramento medidas; // As medidas de cada monitoramento já convertidas em números, uma coluna por medida
+
+    /**
+     * Acrescenta um monitoramento e suas medidas
+    */
+    void acrescentar_monitoramento(DadosDeMonitoramento dados_de_monitoramento) {
+      monitoramento.push_back(std::move(dados_de_monitoramento));
+      completar_medidas();
+    }
+
+    /**
+     * Converte as medidas dos monitoramentos que ainda não estão nas colunas
+     * (os acrescentados direto em "monitoramento"). Se monitoramentos foram
+     * removidos, refaz as colunas
+    */
+    void completar_medidas() {
+      if (medidas.size() > monitoramento.size()) {
+        medidas.clear();
+      }
+      medidas.reservar(monitoramento.size());
+      for (size_t index = medidas.size(); index < monitoramento.size();
+           ++index) {
+        const auto &texto = monitoramento[index].dados;
+        medidas.acrescentar(texto[EsquemaDeMonitoramento::DataDaAvaliacao],
+                            texto[EsquemaDeMonitoramento::Temperatura],
+                            texto[EsquemaDeMonitoramento::Peso],
+                            texto[EsquemaDeMonitoramento::Altura],
+                            texto[EsquemaDeMonitoramento::SangueFoiColetado]);
+      }
+    }
 
     /**
      * Leia os valores que o usuário der para cada dado do animal
     */
     void leia_valores() {
-      for (const std::string &dado : ordem_dos_dados_do_animal) {
+      dados.para_cada_campo([](const std::string &dado, std::string &valor) {
         std::cout << dado << ": ";
-        std::string entrada;
-        std::getline(std::cin, entrada);
-        dados[dado] = entrada;
-      }
+        std::getline(std::cin, valor);
+      });
     }
 
     /**
      * Printar dados do animal e do monitoramento
     */
-    void printar_valores() {
-      for (const std::string &dado : ordem_dos_dados_do_animal) {
-        std::cout << dado << ": " << dados[dado] << '\n';
-      }
-      for (int index = 0; index < monitoramento.size(); ++index) {
+    void printar_valores() const {
+      dados.para_cada_campo(
+          [](const std::string &dado, const std::string &valor) {
+            std::cout << dado << ": " << valor << '\n';
+          });
+      for (size_t index = 0; index < monitoramento.size(); ++index) {
         std::cout << "dados do monitoramento " << index + 1 << ":\n";
         monitoramento[index].printar_valores();
       }
@@ -95,9 +352,28 @@ public:
   };
 
   /**
-   * Constructor
+   * Uma avaliação no índice por data: o dia, o animal e a linha do
+   * monitoramento dele, o índice em DadosDoAnimal::monitoramento
   */
-  Dados(const std::string &nome_do_arquivo) {
+  struct Avaliacao {
+    std::int32_t dia;
+    IdType id;
+    std::uint32_t linha;
+
+    bool operator<(const Avaliacao &outra) const {
+      return std::tie(dia, id, linha) <
+             std::tie(outra.dia, outra.id, outra.linha);
+    }
+    bool operator==(const Avaliacao &outra) const {
+      return dia == outra.dia and id == outra.id and linha == outra.linha;
+    }
+  };
+
+  /**
+   * Constructor. "indices" declara os índices secundários mantidos
+  */
+  BasicDados(const std::string &nome_do_arquivo, IndicesDoAnimal indices = {})
+      : m_campos_indexados(std::move(indices)) {
 
     // Atualize m_nome_do_arquivo
     m_nome_do_arquivo = nome_do_arquivo;
@@ -114,22 +390,28 @@ public:
     getline(arquivo, line); // ignora a primeira linha 
     // Essa linha: " Apelido | Primeiro dia de monitoramento | Espécie | Sexo | Data de nascimento | "
 
+    // Registros lidos, na ordem do arquivo
+    std::deque<std::pair<IdType, DadosDoAnimal>> animais;
+    bool ordenado = true; // ids estritamente crescentes, como salvar_dados escreve
+
     // Enquanto arquivo não chegou no final e há linhas para ler
     while (!arquivo.eof() && std::getline(arquivo, line)) {
       std::stringstream ss(line); // Passe line para ss
       std::string token;  // Tokens da linha
 
-      IdType id;
-      getline(ss, id, '|'); // Lê os dados em ss até encontrar '|' e passa para id
-
-      DadosDoAnimal animal_data;
+      // O registro é lido direto no fim de animais, sem cópias
+      auto &[id, animal_data] = animais.emplace_back();
+      getline(ss, token, '|'); // Lê os dados em ss até encontrar '|' e passa para token
+      bool id_lido = ler_id(token, id);
+      std::string texto_do_id = id_lido ? std::string() : token;
+      ordenado = ordenado and (animais.size() == 1 or
+                               std::prev(animais.end(), 2)->first < id);
       // Repita 5 vezes (numero_dados_animal)
 
       // Comentar resto (TODO)
 
-      for (int index = 0; index < NumeroDeDadosDoAnimal; ++index) { 
-        getline(ss, token, '|');
-        animal_data.dados[ordem_dos_dados_do_animal[index]] = token;
+      for (std::string &valor : animal_data.dados.valores) {
+        getline(ss, valor, '|');
       }
 
       getline(ss, token);
@@ -138,117 +420,862 @@ public:
       for (int counter = 0; counter < numero_de_monitoramentos; ++counter) {
         getline(arquivo, line);
         std::stringstream ss2(line);
-        DadosDeMonitoramento dados_de_monitoramento;
-        for (int index = 0; index < NumeroDeDadosDeMonitoramento - 1; ++index) {
-          getline(ss2, token, '|');
-          dados_de_monitoramento
-              .dados[ordem_dos_dados_de_monitoramento[index]] = token;
+        DadosDeMonitoramento &dados_de_monitoramento =
+            animal_data.monitoramento.emplace_back();
+        auto &valores = dados_de_monitoramento.dados.valores;
+        for (auto valor = valores.begin(); valor != valores.end() - 1;
+             ++valor) {
+          getline(ss2, *valor, '|');
         }
-        getline(ss2, token);
-        dados_de_monitoramento.dados[ordem_dos_dados_de_monitoramento
-                                         [NumeroDeDadosDeMonitoramento - 1]] =
-            token;
-        animal_data.monitoramento.push_back(dados_de_monitoramento);
+        getline(ss2, valores.back()); // o último vai até o fim da linha
+      }
+      if (!id_lido) { // o registro é lido mesmo assim, para pular suas linhas
+        std::cerr << "id invalido ignorado: " << texto_do_id << '\n';
+        animais.pop_back();
+        m_arquivo_incompleto = true;
+      } else {
+        animal_data.completar_medidas();
       }
-      m_dados.insert({id, animal_data});
+    }
+
+    // Move os registros para os nós, sem copiar os textos. Um arquivo ordenado
+    // vira a árvore em tempo linear, sem rotações. Nos outros, cada registro
+    // é procurado primeiro ao lado do anterior no seu fragmento, o que evita
+    // a descida desde a raiz nos trechos em ordem
+    if (ordenado) {
+      m_dados.build_from_sorted(std::make_move_iterator(animais.begin()),
+                                std::make_move_iterator(animais.end()));
+      if (tem_indices()) {
+        for (size_t fragmento = 0; fragmento < numero_de_fragmentos;
+             ++fragmento) {
+          const auto &arvore = arvore_do_fragmento(fragmento);
+          for (auto it = arvore.begin(); it != arvore.end(); ++it) {
+            indexar(fragmento, it->first, it->second);
+          }
+        }
+      }
+    } else {
+      size_t lidos = animais.size();
+      inserir_em_lote(animais);
+      if (m_dados.size() != lidos) {
+        std::cerr << lidos - m_dados.size()
+                  << " registros com id repetido ignorados\n";
+        m_arquivo_incompleto = true;
+      }
+    }
+    if (m_arquivo_incompleto) {
+      std::cerr << "O arquivo " << m_nome_do_arquivo
+                << " nao sera sobrescrito, para nao perder esses registros\n";
     }
   }
 
-  ~Dados() { salvar_dados(); }  // Deconstrutor
+  ~BasicDados() { salvar_dados(); }  // Deconstrutor
 
   /**
-   * Inserir animal na árvore AVL
+   * Inserir animal na árvore, movendo o id e os dados para o nó
   */
-  void inserir_animal(const IdType &id, const DadosDoAnimal &dados_do_animal) {
-    m_dados.insert({id, dados_do_animal});
+  void inserir_animal(IdType id, DadosDoAnimal dados_do_animal) {
+    dados_do_animal.completar_medidas();
+    size_t fragmento = indice_do_fragmento(id);
+    std::unique_lock<trava> arvore(m_travas_das_arvores[fragmento]);
+    auto [it, inserido] = arvore_do_fragmento(fragmento).try_emplace(
+        std::move(id), std::move(dados_do_animal));
+    if (inserido) {
+      indexar(fragmento, it->first, it->second);
+    }
   }
 
-  void remover_animal(const IdType &id) { m_dados.erase(id); }
+  /**
+   * Insere os animais do lote cujos ids ainda não existem, movendo-os para
+   * os nós. Com fragmentos, cada thread aplica o lote a alguns deles
+  */
+  void inserir_animais(
+      std::vector<std::pair<IdType, DadosDoAnimal>> animais) {
+    inserir_em_lote(animais);
+  }
 
-  DadosDoAnimal consultar_fauna(const IdType &id) {
-    return m_dados.find(id)->second;
+  void remover_animal(IdBusca id) {
+    size_t fragmento = indice_do_fragmento(id);
+    std::unique_lock<trava> arvore(m_travas_das_arvores[fragmento]);
+    auto &animais = arvore_do_fragmento(fragmento);
+    auto it = animais.find(id);
+    if (it == animais.end()) {
+      return;
+    }
+    desindexar(fragmento, it->first, it->second);
+    animais.erase(it);
   }
 
+  /**
+   * Dados do animal com esse id, sem copiá-los. Com AcessoConcorrente, a
+   * referência fica sem trava: use a consulta com callback se outras threads
+   * escrevem. Mudar por ela um campo indexado deixa os índices desatualizados
+   * \throw std::out_of_range se não existe animal com esse id
+  */
+  DadosDoAnimal &consultar_fauna(IdBusca id) {
+    auto &animais = arvore_do_fragmento(indice_do_fragmento(id));
+    auto it = animais.find(id);
+    if (it == animais.end()) {
+      throw std::out_of_range("nenhum animal com esse id");
+    }
+    return *it;
+  }
+
+  /**
+   * Chama callback(dados_do_animal) com os dados do animal com esse id,
+   * travados para leitura enquanto ela roda
+   * \return se o animal existe
+  */
+  template <typename Callback>
+  bool consultar_fauna(IdBusca id, Callback callback) const {
+    size_t fragmento = indice_do_fragmento(id);
+    std::shared_lock<trava> arvore(m_travas_das_arvores[fragmento]);
+    const auto &animais = arvore_do_fragmento(fragmento);
+    auto it = animais.find(id);
+    if (it == animais.end()) {
+      return false;
+    }
+    std::shared_lock<trava> animal(trava_do_animal(id));
+    callback(*it);
+    return true;
+  }
+
+  /**
+   * Acrescenta um monitoramento ao animal, se ele existe. Só o animal é
+   * travado para escrita, e o índice das avaliações do fragmento, se há um
+  */
   void inserir_monitoramento_do_animal(
-      const IdType &id, const DadosDeMonitoramento &dados_de_monitoramento) {
-    m_dados.find(id)->second.monitoramento.push_back(dados_de_monitoramento);
+      IdBusca id, DadosDeMonitoramento dados_de_monitoramento) {
+    size_t fragmento = indice_do_fragmento(id);
+    std::shared_lock<trava> arvore(m_travas_das_arvores[fragmento]);
+    auto &animais = arvore_do_fragmento(fragmento);
+    auto it = animais.find(id);
+    if (it == animais.end()) {
+      return;
+    }
+    std::unique_lock<trava> animal(trava_do_animal(id));
+    it->second.acrescentar_monitoramento(std::move(dados_de_monitoramento));
+    if (m_campos_indexados.avaliacoes_por_data) {
+      // Outras threads acrescentam monitoramentos a este fragmento junto
+      std::unique_lock<trava> avaliacoes(m_travas_das_avaliacoes[fragmento]);
+      indexar_avaliacao(fragmento, it->first, it->second.medidas,
+                        it->second.medidas.size() - 1);
+    }
+  }
+
+  /**
+   * Acrescenta cada monitoramento do lote ao seu animal, ignorando ids que
+   * não existem. Com fragmentos, os monitoramentos de fragmentos diferentes
+   * (de várias estações de campo, por exemplo) são aplicados em paralelo,
+   * cada fragmento travado uma vez para o lote todo
+  */
+  void inserir_monitoramentos(
+      std::vector<std::pair<IdType, DadosDeMonitoramento>> monitoramentos) {
+    distribuir_lote(monitoramentos, [this](size_t fragmento,
+                                           const auto &registros) {
+      std::unique_lock<trava> arvore(m_travas_das_arvores[fragmento]);
+      auto &animais = arvore_do_fragmento(fragmento);
+      for (auto *registro : registros) {
+        auto it = animais.find(registro->first);
+        if (it != animais.end()) {
+          it->second.acrescentar_monitoramento(std::move(registro->second));
+          if (m_campos_indexados.avaliacoes_por_data) {
+            indexar_avaliacao(fragmento, it->first, it->second.medidas,
+                              it->second.medidas.size() - 1);
+          }
+        }
+      }
+    });
+  }
+
+  /**
+   * Acrescenta de uma vez os animais de outros dados (outro arquivo já
+   * carregado) cujos ids ainda não existem; num id repetido, ficam os dados
+   * daqui. A união é feita AVL com AVL, por splits e joins, em
+   * O(m log(n/m + 1)) para m animais de um lado e n do outro, em vez de m
+   * inserções. Os fragmentos, que usam o mesmo hash nos dois, são unidos em
+   * paralelo; numa árvore de 2^16 animais ou mais, as metades de cada split
+   * também são unidas em outras threads, o que a AVL só faz com o
+   * std::allocator (com um SlabAllocator, a união é serial). A cópia dos
+   * animais de "outro", antes da união, é serial. Trava para escrita os fragmentos daqui e também os de
+   * "outro", cujos animais são copiados: os monitoramentos mudam um animal
+   * com o fragmento travado só para leitura. Os dados de menor endereço são
+   * travados primeiro, e a.mesclar(b) e b.mesclar(a) ao mesmo tempo não se
+   * travam um ao outro. Com índices secundários, os m animais de "outro"
+   * são procurados aqui antes da união, para indexar os que ela acrescenta.
+   * Não compila com árvores rubro-negras, que não têm essa união
+  */
+  void mesclar(const BasicDados &outro) {
+    static_assert(Armazenamento::tem_uniao,
+                  "mesclar une arvores AVL; a arvore rubro-negra nao tem "
+                  "split e join. Use ArmazenamentoAVL");
+    if (&outro == this) {
+      return;
+    }
+    std::array<std::unique_lock<trava>, numero_de_fragmentos> arvores;
+    std::array<std::unique_lock<trava>, numero_de_fragmentos> arvores_do_outro;
+    if (std::less<const BasicDados *>{}(this, &outro)) {
+      arvores = travar_todas_as_arvores();
+      arvores_do_outro = outro.travar_todas_as_arvores();
+    } else {
+      arvores_do_outro = outro.travar_todas_as_arvores();
+      arvores = travar_todas_as_arvores();
+    }
+    auto unir = [&](size_t fragmento) {
+      auto &arvore = arvore_do_fragmento(fragmento);
+      const auto &outra = outro.arvore_do_fragmento(fragmento);
+      if (tem_indices()) {
+        for (auto it = outra.begin(); it != outra.end(); ++it) {
+          if (!arvore.contains(it->first)) {
+            indexar(fragmento, it->first, it->second);
+          }
+        }
+      }
+      arvore.unite(outra);
+    };
+    if constexpr (numero_de_fragmentos == 1) {
+      unir(0);
+    } else {
+      arvore_dos_animais::for_each_shard(unir);
+    }
   }
 
-  void salvar_dados() {
+  /**
+   * Escreve os animais no arquivo, a não ser que a carga tenha ignorado
+   * registros dele (ids inválidos ou repetidos): sobrescrevê-lo os apagaria
+   * \return se o arquivo foi escrito
+  */
+  bool salvar_dados() const {
+    if (m_arquivo_incompleto) {
+      std::cerr << "Arquivo " << m_nome_do_arquivo
+                << " nao salvo: a carga ignorou registros dele\n";
+      return false;
+    }
     std::ofstream arquivo(m_nome_do_arquivo);
     for (const std::string &dado : ordem_dos_dados_do_animal) {
       arquivo << dado << " | ";
     }
     arquivo << "\n";
 
+    auto arvores = ler_todas_as_arvores();
     for (auto it = m_dados.begin(); it != m_dados.end(); ++it) {
+      std::shared_lock<trava> animal(trava_do_animal(it->first));
       arquivo << it->first << '|';
-      for (const std::string &dados_do_animal : ordem_dos_dados_do_animal) {
-        arquivo << it->second.dados[dados_do_animal] << '|';
-      }
+      it->second.dados.para_cada_campo(
+          [&arquivo](const std::string &, const std::string &valor) {
+            arquivo << valor << '|';
+          });
       arquivo << it->second.monitoramento.size() << "\n";
-      for (DadosDeMonitoramento &monitoramento : it->second.monitoramento) {
-        for (const std::string &dados_de_monitoramento :
-             ordem_dos_dados_de_monitoramento) {
-          arquivo << monitoramento.dados[dados_de_monitoramento];
-          if (dados_de_monitoramento !=
-              ordem_dos_dados_de_monitoramento[NumeroDeDadosDeMonitoramento -
-                                               1]) {
-            arquivo << '|';
-          }
-        }
+      for (const DadosDeMonitoramento &monitoramento :
+           it->second.monitoramento) {
+        const char *separador = "";
+        monitoramento.dados.para_cada_campo(
+            [&](const std::string &, const std::string &valor) {
+              arquivo << separador << valor;
+              separador = "|";
+            });
         arquivo << "\n";
       }
     }
-    auto it = m_dados.end();
-    if (it != nullptr) {
+    return true;
+  }
 
-      arquivo << it->first << '|';
-      for (const std::string &dados_do_animal : ordem_dos_dados_do_animal) {
-        arquivo << it->second.dados[dados_do_animal] << '|';
+  /**
+   * Verifica se id é válido. Ids texto são aceitos como std::string_view ou
+   * const char*, sem construir uma std::string
+  */
+  bool id_valido(IdBusca id) const {
+    size_t fragmento = indice_do_fragmento(id);
+    std::shared_lock<trava> arvore(m_travas_das_arvores[fragmento]);
+    return arvore_do_fragmento(fragmento).contains(id);
+  }
+
+  void imprima_todos_os_dados() const {
+    auto arvores = ler_todas_as_arvores();
+    for (auto it = m_dados.begin(); it != m_dados.end(); ++it) {
+      std::shared_lock<trava> animal(trava_do_animal(it->first));
+      std::cout << "id: " << it->first << "\n";
+      it->second.printar_valores();
+    }
+  }
+
+  /**
+   * Chama callback(id, dados_do_animal) para cada animal com id entre
+   * "id_inicio" e "id_fim", inclusive, em ordem de id. Os dados são passados
+   * por referência, sem cópias, e só os animais do intervalo são visitados
+  */
+  template <typename Callback>
+  void consultar_intervalo(IdBusca id_inicio, IdBusca id_fim,
+                           Callback callback) const {
+    if (id_fim < id_inicio) {
+      return; // intervalo vazio
+    }
+    auto arvores = ler_todas_as_arvores();
+    auto fim = m_dados.upper_bound(id_fim);
+    for (auto it = m_dados.lower_bound(id_inicio); it != fim; ++it) {
+      std::shared_lock<trava> animal(trava_do_animal(it->first));
+      callback(it->first, it->second);
+    }
+  }
+
+  /**
+   * Imprime a página "pagina" (a partir de 0) da listagem por id, com
+   * "animais_por_pagina" animais. O início da página é achado em O(log n),
+   * sem percorrer as anteriores
+  */
+  void imprima_pagina(size_t pagina, size_t animais_por_pagina) const {
+    auto arvores = ler_todas_as_arvores();
+    auto pagina_atual = m_dados.page(pagina, animais_por_pagina);
+    for (auto it = pagina_atual.begin(); it != pagina_atual.end(); ++it) {
+      std::shared_lock<trava> animal(trava_do_animal(it->first));
+      std::cout << "id: " << it->first << "\n";
+      it->second.printar_valores();
+    }
+  }
+
+  /**
+   * Posição do id na listagem por id (a partir de 0), ou seja, quantos ids
+   * vêm antes dele
+  */
+  size_t posicao_do_animal(IdBusca id) const {
+    auto arvores = ler_todas_as_arvores();
+    return m_dados.rank(id);
+  }
+
+  /**
+   * Número de animais
+  */
+  size_t numero_de_animais() const {
+    auto arvores = ler_todas_as_arvores();
+    return m_dados.size();
+  }
+
+  /**
+   * Confere os invariantes da árvore dos animais e mede sua forma (altura,
+   * profundidades, caminho médio de uma busca) em O(n), para ver se a
+   * distribuição real dos ids a degenerou
+  */
+  tree::TreeStats estatisticas_da_arvore() const {
+    auto arvores = ler_todas_as_arvores();
+    return m_dados.validate();
+  }
+
+  /**
+   * Média, mínimo e máximo da temperatura e do peso de cada espécie, nas
+   * avaliações com data na janela. Só as colunas de medidas são percorridas,
+   * pelos kernels vetoriais de analise.h; o texto da espécie é lido uma vez
+   * por animal
+  */
+  std::map<std::string, ResumoDaEspecie>
+  resumo_por_especie(JanelaDeDias janela = {}) const {
+    std::map<std::string, ResumoDaEspecie> resumos;
+    ler_cada_animal([&](const IdType &, const DadosDoAnimal &animal) {
+      const ColunasDeMonitoramento &medidas = animal.medidas;
+      Agregado temperatura = agregar(medidas.temperaturas(), medidas.dias(),
+                                     medidas.size(), janela);
+      Agregado peso =
+          agregar(medidas.pesos(), medidas.dias(), medidas.size(), janela);
+      if (temperatura.contagem == 0 and peso.contagem == 0) {
+        return;
       }
-      arquivo << it->second.monitoramento.size() << "\n";
-      for (DadosDeMonitoramento &monitoramento : it->second.monitoramento) {
-        for (const std::string &dados_de_monitoramento :
-             ordem_dos_dados_de_monitoramento) {
-          arquivo << monitoramento.dados[dados_de_monitoramento];
-          if (dados_de_monitoramento !=
-              ordem_dos_dados_de_monitoramento[NumeroDeDadosDeMonitoramento -
-                                               1]) {
-            arquivo << '|';
-          }
+      ResumoDaEspecie &resumo = resumos[animal.dados[EsquemaDoAnimal::Especie]];
+      ++resumo.animais;
+      resumo.temperatura.juntar(temperatura);
+      resumo.peso.juntar(peso);
+    });
+    return resumos;
+  }
+
+  /**
+   * Ids, em ordem, dos animais com alguma temperatura acima de "limite" em
+   * avaliações com data na janela
+  */
+  std::vector<IdType> animais_com_temperatura_acima(
+      float limite, JanelaDeDias janela = {}) const {
+    std::vector<IdType> ids;
+    ler_cada_animal([&](const IdType &id, const DadosDoAnimal &animal) {
+      const ColunasDeMonitoramento &medidas = animal.medidas;
+      if (contar_acima(medidas.temperaturas(), medidas.dias(), medidas.size(),
+                       janela, limite) > 0) {
+        ids.push_back(id);
+      }
+    });
+    return ids;
+  }
+
+  /**
+   * Quantas temperaturas de avaliações na janela caem em cada uma das
+   * "faixas" faixas entre "minimo" e "maximo"
+  */
+  Histograma histograma_de_temperaturas(float minimo, float maximo,
+                                        size_t faixas,
+                                        JanelaDeDias janela = {}) const {
+    Histograma histograma(minimo, maximo, faixas);
+    ler_cada_animal([&](const IdType &, const DadosDoAnimal &animal) {
+      const ColunasDeMonitoramento &medidas = animal.medidas;
+      acumular_histograma(medidas.temperaturas(), medidas.dias(),
+                          medidas.size(), janela, histograma);
+    });
+    return histograma;
+  }
+
+  /**
+   * Ids, em ordem, dos animais cujo campo "campo" tem exatamente o texto
+   * "valor". Com o campo em IndicesDoAnimal::por_valor, os ids vêm do índice
+   * hash, em tempo proporcional ao número de animais achados; sem ele, todos
+   * os animais são lidos
+  */
+  std::vector<IdType> animais_com(EsquemaDoAnimal::Campo campo,
+                                  std::string_view valor) const {
+    std::vector<IdType> ids;
+    if (!indexado(m_campos_indexados.por_valor, campo)) {
+      ler_cada_animal([&](const IdType &id, const DadosDoAnimal &animal) {
+        if (animal.dados[campo] == valor) {
+          ids.push_back(id);
         }
-        arquivo << "\n";
+      });
+      return ids;
+    }
+    auto arvores = ler_todas_as_arvores();
+    std::string chave(valor);
+    for (const IndicesDoFragmento &indices : m_indices) {
+      auto achados = indices.por_valor[campo].find(chave);
+      if (achados != indices.por_valor[campo].end()) {
+        ids.insert(ids.end(), achados->second.begin(), achados->second.end());
       }
     }
+    if constexpr (numero_de_fragmentos > 1) {
+      std::sort(ids.begin(), ids.end()); // intercala os fragmentos
+    }
+    return ids;
   }
 
   /**
-   * Verifica se id é válido
+   * Ids dos animais com a data do campo "campo" na janela, em ordem de data
+   * e, no mesmo dia, de id. Datas que não puderam ser lidas ficam de fora.
+   * Com o campo em IndicesDoAnimal::por_data, o começo da janela é achado no
+   * índice ordenado em O(log n) e só os animais dela são percorridos; sem
+   * ele, todos os animais são lidos
   */
-  bool id_valido(const IdType &id) {
-    if (m_dados.find(id) == nullptr) {
-      return false;
+  std::vector<IdType> animais_com_data_entre(EsquemaDoAnimal::Campo campo,
+                                             JanelaDeDias janela) const {
+    std::vector<std::pair<std::int32_t, IdType>> achados;
+    if (!indexado(m_campos_indexados.por_data, campo)) {
+      ler_cada_animal([&](const IdType &id, const DadosDoAnimal &animal) {
+        std::int32_t dia = ler_data(animal.dados[campo]);
+        if (dia != DiaDesconhecido and janela.contem(dia)) {
+          achados.emplace_back(dia, id);
+        }
+      });
+      std::sort(achados.begin(), achados.end());
+    } else {
+      auto arvores = ler_todas_as_arvores();
+      for (const IndicesDoFragmento &indices : m_indices) {
+        const auto &por_data = indices.por_data[campo];
+        for (auto it = por_data.lower_bound({janela.inicio, IdType{}});
+             it != por_data.end() and it->first <= janela.fim; ++it) {
+          achados.push_back(*it);
+        }
+      }
+      if constexpr (numero_de_fragmentos > 1) {
+        std::sort(achados.begin(), achados.end()); // intercala os fragmentos
+      }
     }
-    return true;
+    std::vector<IdType> ids;
+    ids.reserve(achados.size());
+    for (auto &[dia, id] : achados) {
+      ids.push_back(std::move(id));
+    }
+    return ids;
   }
 
-  void imprima_todos_os_dados() {
-    for (auto it = m_dados.begin(); it != m_dados.end(); ++it) {
-      std::cout << "id: " << it->first << "\n";
-      it->second.printar_valores();
+  /**
+   * Avaliações de todos os animais com data na janela, em ordem de data e,
+   * no mesmo dia, de id e linha. Com IndicesDoAnimal::avaliacoes_por_data,
+   * o começo da janela é achado em O(log n) e só as avaliações dela são
+   * percorridas; sem ele, cada animal acha as suas no próprio histórico
+  */
+  std::vector<Avaliacao> avaliacoes_entre(JanelaDeDias janela) const {
+    std::vector<Avaliacao> avaliacoes;
+    if (!m_campos_indexados.avaliacoes_por_data) {
+      ler_cada_animal([&](const IdType &id, const DadosDoAnimal &animal) {
+        const std::int32_t *dias = animal.medidas.dias();
+        auto [primeira, ultima] = historico_na_janela(animal.medidas, janela);
+        for (; primeira != ultima; ++primeira) {
+          avaliacoes.push_back({dias[*primeira], id, *primeira});
+        }
+      });
+      std::sort(avaliacoes.begin(), avaliacoes.end());
+      return avaliacoes;
     }
-    auto it = m_dados.end();
-    if (it != nullptr) {
-      std::cout << "id: " << it->first << "\n";
-      it->second.printar_valores();
+    auto arvores = ler_todas_as_arvores();
+    for (size_t fragmento = 0; fragmento < numero_de_fragmentos; ++fragmento) {
+      std::shared_lock<trava> travadas(m_travas_das_avaliacoes[fragmento]);
+      const auto &indice = m_indices[fragmento].avaliacoes;
+      for (auto it = indice.lower_bound({janela.inicio, IdType{}, 0});
+           it != indice.end() and it->dia <= janela.fim; ++it) {
+        avaliacoes.push_back(*it);
+      }
+    }
+    if constexpr (numero_de_fragmentos > 1) {
+      // intercala os fragmentos
+      std::sort(avaliacoes.begin(), avaliacoes.end());
     }
+    return avaliacoes;
+  }
+
+  /**
+   * Chama callback(dados_de_monitoramento) para cada monitoramento do animal
+   * com data na janela, em ordem de data, com o animal travado para leitura.
+   * O trecho é achado no histórico do animal em O(log k), para k
+   * monitoramentos
+   * \return se o animal existe
+  */
+  template <typename Callback>
+  bool consultar_historico(IdBusca id, JanelaDeDias janela,
+                           Callback callback) const {
+    return consultar_fauna(id, [&](const DadosDoAnimal &animal) {
+      auto [primeira, ultima] = historico_na_janela(animal.medidas, janela);
+      for (; primeira != ultima; ++primeira) {
+        callback(animal.monitoramento[*primeira]);
+      }
+    });
+  }
+
+  /**
+   * Chama callback(dados_de_monitoramento) com a avaliação mais recente do
+   * animal, achada em O(1) depois da busca do id
+   * \return se o animal existe e tem alguma avaliação com data
+  */
+  template <typename Callback>
+  bool consultar_ultima_avaliacao(IdBusca id, Callback callback) const {
+    bool achou = false;
+    consultar_fauna(id, [&](const DadosDoAnimal &animal) {
+      size_t linha = animal.medidas.ultima_avaliacao();
+      if (linha < animal.medidas.size()) {
+        achou = true;
+        callback(animal.monitoramento[linha]);
+      }
+    });
+    return achou;
   }
 
 private:
-  AVL<IdType, DadosDoAnimal> m_dados;
+  using trava = typename Acesso::trava;
+  using arvore_dos_animais =
+      typename Armazenamento::template arvore<IdType, DadosDoAnimal>;
+  static constexpr size_t numero_de_fragmentos =
+      Armazenamento::numero_de_fragmentos;
+  /**
+   * Trava numa linha de cache só dela, para que threads travando animais
+   * diferentes não disputem a mesma linha. As travas vazias não ocupam linhas
+  */
+  struct alignas(std::is_empty_v<trava> ? alignof(trava) : 64)
+      trava_alinhada : trava {};
+
+  /**
+   * Trava dos dados do animal com esse id. Ids iguais como IdType e como
+   * IdBusca têm o mesmo hash
+  */
+  trava &trava_do_animal(IdBusca id) const {
+    if constexpr (Acesso::numero_de_travas_dos_animais == 1) {
+      return m_travas_dos_animais[0];
+    } else {
+      return m_travas_dos_animais[std::hash<IdBusca>{}(id) %
+                                  Acesso::numero_de_travas_dos_animais];
+    }
+  }
+
+  /**
+   * Fragmento que guarda o id, sempre 0 sem fragmentos
+  */
+  size_t indice_do_fragmento(IdBusca id) const {
+    if constexpr (numero_de_fragmentos == 1) {
+      return 0;
+    } else {
+      return m_dados.shard_of(id);
+    }
+  }
+  /**
+   * Árvore do fragmento "indice"; sem fragmentos, a única
+  */
+  auto &arvore_do_fragmento(size_t indice) {
+    if constexpr (numero_de_fragmentos == 1) {
+      return m_dados;
+    } else {
+      return m_dados.shard(indice);
+    }
+  }
+  const auto &arvore_do_fragmento(size_t indice) const {
+    return const_cast<BasicDados *>(this)->arvore_do_fragmento(indice);
+  }
+
+  /**
+   * Trava todos os fragmentos para leitura, em ordem de índice, para
+   * percorrer os animais de todos
+  */
+  std::array<std::shared_lock<trava>, numero_de_fragmentos>
+  ler_todas_as_arvores() const {
+    std::array<std::shared_lock<trava>, numero_de_fragmentos> travas;
+    for (size_t indice = 0; indice < numero_de_fragmentos; ++indice) {
+      travas[indice] = std::shared_lock<trava>(m_travas_das_arvores[indice]);
+    }
+    return travas;
+  }
+
+  /**
+   * Trava todos os fragmentos para escrita, em ordem de índice. Nem os
+   * monitoramentos mudam os animais enquanto as travas existem
+  */
+  std::array<std::unique_lock<trava>, numero_de_fragmentos>
+  travar_todas_as_arvores() const {
+    std::array<std::unique_lock<trava>, numero_de_fragmentos> travas;
+    for (size_t indice = 0; indice < numero_de_fragmentos; ++indice) {
+      travas[indice] = std::unique_lock<trava>(m_travas_das_arvores[indice]);
+    }
+    return travas;
+  }
+
+  /**
+   * Chama funcao(id, dados_do_animal) para cada animal, em ordem de id, com
+   * os fragmentos travados para leitura e o animal travado enquanto ela roda
+  */
+  template <typename Funcao> void ler_cada_animal(Funcao funcao) const {
+    auto arvores = ler_todas_as_arvores();
+    for (auto it = m_dados.begin(); it != m_dados.end(); ++it) {
+      std::shared_lock<trava> animal(trava_do_animal(it->first));
+      funcao(it->first, it->second);
+    }
+  }
+
+  /**
+   * Índices secundários dos animais de um fragmento, guardados ao lado da
+   * árvore e protegidos pela mesma trava. Só os campos declarados em
+   * m_campos_indexados são preenchidos. As avaliações também mudam com a
+   * árvore travada só para leitura, e então sob a trava das avaliações
+  */
+  struct IndicesDoFragmento {
+    /// Por campo: texto do campo -> ids dos animais com ele, em ordem
+    std::array<std::unordered_map<std::string, std::set<IdType>>,
+               EsquemaDoAnimal::NumeroDeCampos>
+        por_valor;
+    /// Por campo: (dia da data do campo, id), em ordem
+    std::array<std::set<std::pair<std::int32_t, IdType>>,
+               EsquemaDoAnimal::NumeroDeCampos>
+        por_data;
+    /// As avaliações com data dos animais, em ordem
+    std::set<Avaliacao> avaliacoes;
+  };
+
+  static bool indexado(const std::vector<EsquemaDoAnimal::Campo> &campos,
+                       EsquemaDoAnimal::Campo campo) {
+    return std::find(campos.begin(), campos.end(), campo) != campos.end();
+  }
+  bool tem_indices() const {
+    return !m_campos_indexados.por_valor.empty() or
+           !m_campos_indexados.por_data.empty() or
+           m_campos_indexados.avaliacoes_por_data;
+  }
+
+  /**
+   * As linhas de "medidas" com data na janela, em ordem de data: o trecho
+   * [primeira, ultima) de medidas.em_ordem_de_data(), achado por busca
+   * binária. As de data desconhecida, que vêm primeiro, ficam de fora
+  */
+  static std::pair<const std::uint32_t *, const std::uint32_t *>
+  historico_na_janela(const ColunasDeMonitoramento &medidas,
+                      JanelaDeDias janela) {
+    const std::int32_t *dias = medidas.dias();
+    const std::uint32_t *ordem = medidas.em_ordem_de_data();
+    const std::uint32_t *fim = ordem + medidas.size();
+    const std::uint32_t *primeira = std::lower_bound(
+        ordem, fim, std::max(janela.inicio, DiaDesconhecido + 1),
+        [dias](std::uint32_t linha, std::int32_t dia) {
+          return dias[linha] < dia;
+        });
+    const std::uint32_t *ultima =
+        std::upper_bound(primeira, fim, janela.fim,
+                         [dias](std::int32_t dia, std::uint32_t linha) {
+                           return dia < dias[linha];
+                         });
+    return {primeira, ultima};
+  }
+
+  /**
+   * Acrescenta a avaliação da linha "linha" ao índice das avaliações, se a
+   * data dela é conhecida
+  */
+  void indexar_avaliacao(size_t fragmento, const IdType &id,
+                         const ColunasDeMonitoramento &medidas, size_t linha) {
+    std::int32_t dia = medidas.dias()[linha];
+    if (dia != DiaDesconhecido) {
+      m_indices[fragmento].avaliacoes.insert(
+          {dia, id, static_cast<std::uint32_t>(linha)});
+    }
+  }
+
+  /**
+   * Acrescenta o animal aos índices do seu fragmento, que deve estar travado
+   * para escrita
+  */
+  void indexar(size_t fragmento, const IdType &id,
+               const DadosDoAnimal &animal) {
+    IndicesDoFragmento &indices = m_indices[fragmento];
+    for (EsquemaDoAnimal::Campo campo : m_campos_indexados.por_valor) {
+      indices.por_valor[campo][animal.dados[campo]].insert(id);
+    }
+    for (EsquemaDoAnimal::Campo campo : m_campos_indexados.por_data) {
+      std::int32_t dia = ler_data(animal.dados[campo]);
+      if (dia != DiaDesconhecido) {
+        indices.por_data[campo].emplace(dia, id);
+      }
+    }
+    if (m_campos_indexados.avaliacoes_por_data) {
+      for (size_t linha = 0; linha < animal.medidas.size(); ++linha) {
+        indexar_avaliacao(fragmento, id, animal.medidas, linha);
+      }
+    }
+  }
+  /**
+   * Tira o animal dos índices do seu fragmento, que deve estar travado para
+   * escrita. Um texto sem mais animais sai do índice hash
+  */
+  void desindexar(size_t fragmento, const IdType &id,
+                  const DadosDoAnimal &animal) {
+    IndicesDoFragmento &indices = m_indices[fragmento];
+    for (EsquemaDoAnimal::Campo campo : m_campos_indexados.por_valor) {
+      auto ids = indices.por_valor[campo].find(animal.dados[campo]);
+      if (ids != indices.por_valor[campo].end()) {
+        ids->second.erase(id);
+        if (ids->second.empty()) {
+          indices.por_valor[campo].erase(ids);
+        }
+      }
+    }
+    for (EsquemaDoAnimal::Campo campo : m_campos_indexados.por_data) {
+      indices.por_data[campo].erase({ler_data(animal.dados[campo]), id});
+    }
+    if (m_campos_indexados.avaliacoes_por_data) {
+      for (size_t linha = 0; linha < animal.medidas.size(); ++linha) {
+        indices.avaliacoes.erase({animal.medidas.dias()[linha], id,
+                                  static_cast<std::uint32_t>(linha)});
+      }
+    }
+  }
+
+  /**
+   * Chama aplicar(indice, registros) para cada fragmento com algum registro
+   * do lote, passando ponteiros para eles na ordem do lote. Com fragmentos,
+   * as partes do lote são espalhadas em paralelo (uma parte por fragmento) e
+   * cada fragmento é aplicado por uma só thread
+  */
+  template <typename Lote, typename Aplicar>
+  void distribuir_lote(Lote &lote, Aplicar aplicar) {
+    using registro = typename Lote::value_type;
+    if constexpr (numero_de_fragmentos == 1) {
+      std::vector<registro *> registros;
+      registros.reserve(lote.size());
+      for (registro &atual : lote) {
+        registros.push_back(&atual);
+      }
+      if (!registros.empty()) {
+        aplicar(0, registros);
+      }
+    } else {
+      std::vector<size_t> destinos(lote.size());
+      arvore_dos_animais::for_each_shard([&](size_t parte) {
+        size_t fim = lote.size() * (parte + 1) / numero_de_fragmentos;
+        for (size_t index = lote.size() * parte / numero_de_fragmentos;
+             index < fim; ++index) {
+          destinos[index] = indice_do_fragmento(lote[index].first);
+        }
+      });
+      arvore_dos_animais::for_each_shard([&](size_t fragmento) {
+        std::vector<registro *> registros;
+        for (size_t index = 0; index < lote.size(); ++index) {
+          if (destinos[index] == fragmento) {
+            registros.push_back(&lote[index]);
+          }
+        }
+        if (!registros.empty()) {
+          aplicar(fragmento, registros);
+        }
+      });
+    }
+  }
+  /**
+   * Insere os animais do lote (pares id, dados) cujos ids ainda não existem,
+   * começando cada busca ao lado do animal anterior do mesmo fragmento
+  */
+  template <typename Lote> void inserir_em_lote(Lote &animais) {
+    distribuir_lote(animais, [this](size_t fragmento, const auto &registros) {
+      for (auto *registro : registros) {
+        registro->second.completar_medidas(); // antes de travar o fragmento
+      }
+      std::unique_lock<trava> arvore(m_travas_das_arvores[fragmento]);
+      auto &animais_do_fragmento = arvore_do_fragmento(fragmento);
+      auto anterior = animais_do_fragmento.end();
+      for (auto *registro : registros) {
+        size_t antes = animais_do_fragmento.size();
+        anterior = animais_do_fragmento.try_emplace(
+            anterior, std::move(registro->first), std::move(registro->second));
+        if (animais_do_fragmento.size() != antes) {
+          indexar(fragmento, anterior->first, anterior->second);
+        }
+      }
+    });
+  }
+
+  arvore_dos_animais m_dados;
+  IndicesDoAnimal m_campos_indexados;
+  IndicesDoFragmento m_indices[numero_de_fragmentos];
   /**
    * Name of the archive
   */
   std::string m_nome_do_arquivo;
+  /**
+   * Se a carga ignorou registros do arquivo, que então não é sobrescrito
+  */
+  bool m_arquivo_incompleto{false};
+  /**
+   * Uma por fragmento, travada para leitura por quem só lê o fragmento ou
+   * escreve num animal, e para escrita por quem insere ou remove animais
+  */
+  mutable trava_alinhada m_travas_das_arvores[numero_de_fragmentos];
+  mutable trava_alinhada
+      m_travas_dos_animais[Acesso::numero_de_travas_dos_animais];
+  /**
+   * Uma por fragmento, para acrescentar ao índice das avaliações com a
+   * árvore travada só para leitura. Tomada depois das travas dos animais
+  */
+  mutable trava_alinhada m_travas_das_avaliacoes[numero_de_fragmentos];
 };
+
+/**
+ * Dados com ids texto, como no arquivo
+*/
+using Dados = BasicDados<std::string>;
+
+/**
+ * Dados com ids numéricos, lidos do texto na carga e escritos de volta como
+ * números
+*/
+using DadosNumericos = BasicDados<std::uint64_t>;
+
+/**
+ * Dados com ids texto guardados na árvore rubro-negra
+*/
+using DadosRubroNegros = BasicDados<std::string, ArmazenamentoRubroNegro>;
+
+/**
+ * Dados com ids texto usados por várias threads ao mesmo tempo
+*/
+using DadosConcorrentes =
+    BasicDados<std::string, ArmazenamentoAVL, AcessoConcorrente>;
+
+/**
+ * Dados com ids texto repartidos em 16 AVLs, cada uma com sua trava, para
+ * inserções e lotes de várias threads
+*/
+using DadosFragmentados = BasicDados<std::string, ArmazenamentoFragmentado<16>,
+                                     AcessoConcorrente>;
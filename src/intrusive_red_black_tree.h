@@ -0,0 +1,247 @@
+#ifndef INTRUSIVEREDBLACKTREE_H
+#define INTRUSIVEREDBLACKTREE_H
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+#include "red_black_hook.h"
+
+// Namespace for tree data-structures.
+namespace tree {
+/**
+ * Red black tree over records that carry their own links: T derives from
+ * RedBlackHook, so linking a record allocates nothing and the record and its
+ * tree linkage share one allocation, wherever the caller keeps the record (a
+ * std::deque, a pool, the stack). The tree does not own the records: erase
+ * and clear only unlink them, and a record must outlive its membership.
+ * Keys are unique.
+ * \tparam T record type, publicly derived from RedBlackHook.
+ * \tparam KeyOf default constructible function object giving the key of a
+ *         record, e.g. returning a reference to one of its members.
+ * \tparam Compare strict weak ordering of the keys; lookups take any type it
+ *         accepts.
+ */
+template <typename T, typename KeyOf, typename Compare = std::less<>>
+class IntrusiveRedBlackTree {
+  static_assert(std::is_base_of_v<RedBlackHook, T>,
+                "records must derive from RedBlackHook");
+
+public:
+  template <bool Const> class basic_iterator;
+  using iterator = basic_iterator<false>;
+  using const_iterator = basic_iterator<true>;
+  using value_type = T;
+  using size_type = size_t;
+
+  IntrusiveRedBlackTree() = default;
+  IntrusiveRedBlackTree(const IntrusiveRedBlackTree &) = delete;
+  IntrusiveRedBlackTree &operator=(const IntrusiveRedBlackTree &) = delete;
+
+  /**
+   * Links "record" unless a record with an equivalent key is already linked.
+   * \return iterator to the record with that key and whether "record" was
+   *         linked.
+   */
+  std::pair<iterator, bool> insert(T &record) {
+    const auto &key = m_key_of(record);
+    RedBlackHook *parent = &m_header;
+    bool left = true;
+    for (RedBlackHook *runner = m_header.left_child; runner != nullptr;) {
+      parent = runner;
+      if (m_compare(key, key_of(runner))) {
+        left = true;
+        runner = runner->left_child;
+      } else if (m_compare(key_of(runner), key)) {
+        left = false;
+        runner = runner->right_child;
+      } else {
+        return {iterator(runner), false};
+      }
+    }
+    if (left and parent == m_begin) {
+      m_begin = &record;
+    }
+    RedBlackAlgorithms::link(&m_header, &record, parent, left);
+    ++m_size;
+    return {iterator(&record), true};
+  }
+
+  /**
+   * Unlinks the record pointed by "it", leaving it to the caller.
+   * \return iterator to the record following it, or end() if it was the last.
+   */
+  iterator erase(const_iterator it) {
+    RedBlackHook *target = const_cast<RedBlackHook *>(it.m_pointer);
+    RedBlackHook *next = RedBlackAlgorithms::successor(target);
+    if (target == m_begin) {
+      m_begin = next;
+    }
+    RedBlackAlgorithms::unlink(&m_header, target);
+    --m_size;
+    return iterator(next);
+  }
+  iterator erase(iterator it) { return erase(const_iterator(it)); }
+  /// Unlinks "record", which must be linked in this tree.
+  iterator erase(T &record) { return erase(iterator(&record)); }
+
+  /// Record whose key is equivalent to "key", or end() if there is none.
+  template <typename Key> iterator find(const Key &key) {
+    return iterator(find_node(key));
+  }
+  template <typename Key> const_iterator find(const Key &key) const {
+    return const_iterator(find_node(key));
+  }
+  template <typename Key> bool contains(const Key &key) const {
+    return find(key) != end();
+  }
+  /// First record whose key is not less than "key", or end().
+  template <typename Key> iterator lower_bound(const Key &key) {
+    return iterator(lower_bound_node(key));
+  }
+  template <typename Key> const_iterator lower_bound(const Key &key) const {
+    return const_iterator(lower_bound_node(key));
+  }
+  /// First record whose key is greater than "key", or end().
+  template <typename Key> iterator upper_bound(const Key &key) {
+    return iterator(upper_bound_node(key));
+  }
+  template <typename Key> const_iterator upper_bound(const Key &key) const {
+    return const_iterator(upper_bound_node(key));
+  }
+
+  iterator begin() { return iterator(m_begin); }
+  const_iterator begin() const { return const_iterator(m_begin); }
+  /// Past-the-end iterator: the header hook.
+  iterator end() { return iterator(&m_header); }
+  const_iterator end() const { return const_iterator(&m_header); }
+
+  bool empty() const { return m_size == 0; }
+  size_type size() const { return m_size; }
+
+  /// Forgets every record in O(1); their hooks are left stale.
+  void clear() {
+    m_header.left_child = nullptr;
+    m_begin = &m_header;
+    m_size = 0;
+  }
+
+  /**
+   * Bidirectional iterator over the records in key order.
+   * \tparam Const whether the records are read-only through it.
+   */
+  template <bool Const> class basic_iterator {
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = std::conditional_t<Const, const T *, T *>;
+    using reference = std::conditional_t<Const, const T &, T &>;
+
+    basic_iterator() = default;
+    /// An iterator converts to a const_iterator.
+    template <bool OtherConst,
+              typename = std::enable_if_t<Const and not OtherConst>>
+    basic_iterator(const basic_iterator<OtherConst> &other)
+        : m_pointer(other.m_pointer) {}
+
+    friend bool operator==(const basic_iterator &lhs,
+                           const basic_iterator &rhs) {
+      return lhs.m_pointer == rhs.m_pointer;
+    }
+    friend bool operator!=(const basic_iterator &lhs,
+                           const basic_iterator &rhs) {
+      return !(lhs == rhs);
+    }
+    reference operator*() const { return *operator->(); }
+    pointer operator->() const { return static_cast<pointer>(m_pointer); }
+    basic_iterator &operator++() {
+      m_pointer = RedBlackAlgorithms::successor(m_pointer);
+      return *this;
+    }
+    basic_iterator operator++(int) {
+      basic_iterator copy = *this;
+      ++(*this);
+      return copy;
+    }
+    basic_iterator &operator--() {
+      m_pointer = RedBlackAlgorithms::predecessor(m_pointer);
+      return *this;
+    }
+    basic_iterator operator--(int) {
+      basic_iterator copy = *this;
+      --(*this);
+      return copy;
+    }
+
+  private:
+    friend class IntrusiveRedBlackTree;
+    using base_pointer =
+        std::conditional_t<Const, const RedBlackHook *, RedBlackHook *>;
+
+    explicit basic_iterator(base_pointer pointer) : m_pointer(pointer) {}
+
+    base_pointer m_pointer{nullptr};
+  };
+
+private:
+  decltype(auto) key_of(const RedBlackHook *hook) const {
+    return m_key_of(*static_cast<const T *>(hook));
+  }
+  /// The header, also reachable from const members.
+  RedBlackHook *header() const {
+    return const_cast<RedBlackHook *>(&m_header);
+  }
+  /// Record holding "key", or the header if there is none.
+  template <typename Key> RedBlackHook *find_node(const Key &key) const {
+    for (RedBlackHook *runner = m_header.left_child; runner != nullptr;) {
+      if (m_compare(key, key_of(runner))) {
+        runner = runner->left_child;
+      } else if (m_compare(key_of(runner), key)) {
+        runner = runner->right_child;
+      } else {
+        return runner;
+      }
+    }
+    return header();
+  }
+  /// First record whose key is not less than "key", or the header.
+  template <typename Key>
+  RedBlackHook *lower_bound_node(const Key &key) const {
+    RedBlackHook *candidate = header();
+    for (RedBlackHook *runner = m_header.left_child; runner != nullptr;) {
+      if (m_compare(key_of(runner), key)) {
+        runner = runner->right_child;
+      } else {
+        candidate = runner;
+        runner = runner->left_child;
+      }
+    }
+    return candidate;
+  }
+  /// First record whose key is greater than "key", or the header.
+  template <typename Key>
+  RedBlackHook *upper_bound_node(const Key &key) const {
+    RedBlackHook *candidate = header();
+    for (RedBlackHook *runner = m_header.left_child; runner != nullptr;) {
+      if (m_compare(key, key_of(runner))) {
+        candidate = runner;
+        runner = runner->left_child;
+      } else {
+        runner = runner->right_child;
+      }
+    }
+    return candidate;
+  }
+
+  size_type m_size{0};
+  RedBlackHook m_header;            //!< Parent of the root and end() sentinel.
+  RedBlackHook *m_begin{&m_header}; //!< Leftmost record, or the header.
+  KeyOf m_key_of;                   //!< Extracts the key of a record.
+  Compare m_compare;                //!< Orders the keys.
+};
+} // namespace tree
+
+#endif // #ifndef INTRUSIVEREDBLACKTREE_H
@@ -1,6 +1,9 @@
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "dados.h"
 
@@ -8,10 +11,13 @@
  * Show operations
 */
 void printar_ajuda() {
-  std::cout << "Digite um numero de 1 a 6 para indicar qual operacao deseja\n";
+  std::cout << "Digite um numero de 1 a 11 para indicar qual operacao deseja\n";
   std::cout << "1 - Inserir animal, 2 - Remover animal, 3 - Consultar id, 4 - "
                "Registrar novo monitoramento, 5 - Salvar arquivo, 6 - Imprimir "
-               "todos os dados, 7 - Encerrar o programa\n";
+               "todos os dados, 7 - Encerrar o programa, 8 - Consultar "
+               "intervalo de ids, 9 - Analisar a saude do rebanho, 10 - Buscar "
+               "animais por especie, sexo ou primeiro dia de monitoramento, "
+               "11 - Listar avaliacoes entre duas datas\n";
 }
 
 void ignorar_caracteres_vazios() {
@@ -35,71 +41,279 @@ int ler_operacao() {
 }
 
 /**
- * Read animal id
+ * Read animal id. Returns false if the text is not a valid id for DadosT
 */
-void leia_id_do_animal(std::string &id) {
+template <typename DadosT>
+bool leia_id_do_animal(typename DadosT::IdType &id) {
   std::cout << "Digite o id do animal: ";
-  std::cin >> id;
+  std::string entrada;
+  std::cin >> entrada;
   ignorar_caracteres_vazios();
+  if (!DadosT::ler_id(entrada, id)) {
+    std::cout << "Id invalido.\n";
+    return false;
+  }
+  return true;
 }
 
-int main(int argc, char *argv[]) {
-  std::string arquivo_de_entrada;
+/**
+ * Read a dd/mm/yyyy date into "dia"; an empty line keeps "dia" unchanged.
+ * Returns false if the text is not a valid date
+*/
+bool leia_dia(const char *pergunta, std::int32_t &dia) {
+  std::cout << pergunta;
+  std::string entrada;
+  std::getline(std::cin, entrada);
+  if (sem_espacos(entrada).empty()) {
+    return true;
+  }
+  dia = ler_data(entrada);
+  if (dia == DiaDesconhecido) {
+    std::cout << "Data invalida.\n";
+    return false;
+  }
+  return true;
+}
 
-  if (argc > 1) {
-    // Se colocou o nome de outro arquivo
-    arquivo_de_entrada = argv[1];
+void printar_agregado(const char *medida, const Agregado &agregado) {
+  std::cout << "\t" << medida << ": ";
+  if (agregado.contagem == 0) {
+    std::cout << "sem avaliacoes\n";
+    return;
+  }
+  std::cout << "media " << agregado.media() << ", minimo " << agregado.minimo
+            << ", maximo " << agregado.maximo << " (" << agregado.contagem
+            << " avaliacoes)\n";
+}
+
+/**
+ * Summarize temperature and weight per species over a window of dates and
+ * list the animals whose temperature went above a limit in that window
+*/
+template <typename DadosT> void analisar_rebanho(const DadosT &dados) {
+  JanelaDeDias janela;
+  if (!leia_dia("Primeiro dia (dd/mm/aaaa, vazio para todos): ",
+                janela.inicio) or
+      !leia_dia("Ultimo dia (dd/mm/aaaa, vazio para todos): ", janela.fim)) {
+    return;
+  }
+  std::cout << "Temperatura limite (vazio para nenhuma): ";
+  std::string entrada;
+  std::getline(std::cin, entrada);
+
+  for (const auto &[especie, resumo] : dados.resumo_por_especie(janela)) {
+    std::cout << "Especie: " << especie << " (" << resumo.animais
+              << " animais)\n";
+    printar_agregado("Temperatura", resumo.temperatura);
+    printar_agregado("Peso", resumo.peso);
+  }
+  if (sem_espacos(entrada).empty()) {
+    return;
+  }
+  float limite = ler_temperatura(entrada);
+  if (limite != limite) { // NaN: não é uma temperatura
+    std::cout << "Temperatura invalida.\n";
+    return;
+  }
+  std::cout << "Animais com temperatura acima de " << limite << ":";
+  for (const auto &id : dados.animais_com_temperatura_acima(limite, janela)) {
+    std::cout << ' ' << id;
+  }
+  std::cout << '\n';
+}
+
+/**
+ * List the animals of a species, of a sex or first monitored between two
+ * dates, through the secondary indexes if the run keeps them, otherwise by
+ * reading every animal
+*/
+template <typename DadosT> void buscar_animais(const DadosT &dados) {
+  std::cout << "Buscar por (1 - Especie, 2 - Sexo, 3 - Primeiro dia de "
+               "monitoramento): ";
+  std::string entrada;
+  std::getline(std::cin, entrada);
+  std::vector<typename DadosT::IdType> ids;
+  if (entrada == "1" or entrada == "2") {
+    EsquemaDoAnimal::Campo campo =
+        entrada == "1" ? EsquemaDoAnimal::Especie : EsquemaDoAnimal::Sexo;
+    std::cout << ordem_dos_dados_do_animal[campo] << ": ";
+    std::getline(std::cin, entrada);
+    ids = dados.animais_com(campo, entrada);
+  } else if (entrada == "3") {
+    JanelaDeDias janela;
+    if (!leia_dia("Primeiro dia (dd/mm/aaaa, vazio para todos): ",
+                  janela.inicio) or
+        !leia_dia("Ultimo dia (dd/mm/aaaa, vazio para todos): ", janela.fim)) {
+      return;
+    }
+    ids = dados.animais_com_data_entre(
+        EsquemaDoAnimal::PrimeiroDiaDeMonitoramento, janela);
   } else {
-    // Se não, use o arquivo padrão
-    arquivo_de_entrada = "fauna.txt";
+    std::cout << "Opcao invalida.\n";
+    return;
   }
-  Dados dados(arquivo_de_entrada);
+  std::cout << ids.size() << " animais:";
+  for (const auto &id : ids) {
+    std::cout << ' ' << id;
+  }
+  std::cout << '\n';
+}
+
+/**
+ * List the evaluations of every animal between two dates, in date order,
+ * through the time index if the run keeps it, otherwise through each
+ * animal's date-sorted history
+*/
+template <typename DadosT> void listar_avaliacoes(const DadosT &dados) {
+  JanelaDeDias janela;
+  if (!leia_dia("Primeiro dia (dd/mm/aaaa, vazio para todos): ",
+                janela.inicio) or
+      !leia_dia("Ultimo dia (dd/mm/aaaa, vazio para todos): ", janela.fim)) {
+    return;
+  }
+  for (const auto &avaliacao : dados.avaliacoes_entre(janela)) {
+    dados.consultar_fauna(
+        avaliacao.id, [&](const typename DadosT::DadosDoAnimal &animal) {
+          std::cout << "id: " << avaliacao.id << ", monitoramento "
+                    << avaliacao.linha + 1 << ":\n";
+          animal.monitoramento[avaliacao.linha].printar_valores();
+        });
+  }
+}
+
+/**
+ * Run the operations over the animals of "arquivo_de_entrada", with ids of
+ * the type chosen by DadosT, keeping the secondary indexes in "indices"
+*/
+template <typename DadosT>
+void executar(const std::string &arquivo_de_entrada,
+              const IndicesDoAnimal &indices) {
+  DadosT dados(arquivo_de_entrada, indices);
 
   printar_ajuda(); // Mostre as operações ao usuário  
   while (true) {   // Continue até operação sair escolhida
     int operacao = ler_operacao();
-    std::string id;
+    typename DadosT::IdType id;
     if (operacao == 1) {
-      leia_id_do_animal(id);
+      if (!leia_id_do_animal<DadosT>(id)) {
+        continue;
+      }
       if (dados.id_valido(id)) {
         std::cout << "Já existe um animal com esse id.\n";
         continue;
       }
-      Dados::DadosDoAnimal dados_do_animal;
+      typename DadosT::DadosDoAnimal dados_do_animal;
       dados_do_animal.leia_valores();
-      dados.inserir_animal(id, dados_do_animal);
+      dados.inserir_animal(std::move(id), std::move(dados_do_animal));
     } else if (operacao == 2) {
-      leia_id_do_animal(id);
+      if (!leia_id_do_animal<DadosT>(id)) {
+        continue;
+      }
       if (!dados.id_valido(id)) {
         std::cout << "não existe nenhum animal com esse id.\n";
         continue;
       }
       dados.remover_animal(id);
     } else if (operacao == 3) {
-      leia_id_do_animal(id);
+      if (!leia_id_do_animal<DadosT>(id)) {
+        continue;
+      }
       if (!dados.id_valido(id)) {
         std::cout << "não existe nenhum animal com esse id.\n";
         continue;
       }
       dados.consultar_fauna(id).printar_valores();
     } else if (operacao == 4) {
-      leia_id_do_animal(id);
+      if (!leia_id_do_animal<DadosT>(id)) {
+        continue;
+      }
       if (!dados.id_valido(id)) {
         std::cout << "não existe nenhum animal com esse id.\n";
         continue;
       }
-      Dados::DadosDeMonitoramento dados_de_monitoramento;
+      typename DadosT::DadosDeMonitoramento dados_de_monitoramento;
       dados_de_monitoramento.leia_valores();
-      dados.inserir_monitoramento_do_animal(id, dados_de_monitoramento);
+      dados.inserir_monitoramento_do_animal(id,
+                                            std::move(dados_de_monitoramento));
     } else if (operacao == 5) {
       dados.salvar_dados();
     } else if (operacao == 6) {
       dados.imprima_todos_os_dados();
     } else if (operacao == 7) { // Se operação = 7, sair
       break;
-    } else {                    // Qualquer outra operação fora de {1,...,7}, mostre a ajuda com as operações 
+    } else if (operacao == 8) {
+      std::string entrada;
+      typename DadosT::IdType id_fim;
+      std::cout << "Primeiro id do intervalo: ";
+      std::getline(std::cin, entrada);
+      bool inicio_valido = DadosT::ler_id(entrada, id);
+      std::cout << "Ultimo id do intervalo: ";
+      std::getline(std::cin, entrada);
+      if (!inicio_valido or !DadosT::ler_id(entrada, id_fim)) {
+        std::cout << "Id invalido.\n";
+        continue;
+      }
+      dados.consultar_intervalo(
+          id, id_fim,
+          [](const typename DadosT::IdType &id_do_animal,
+             const typename DadosT::DadosDoAnimal &animal) {
+            std::cout << "id: " << id_do_animal << "\n";
+            animal.printar_valores();
+          });
+    } else if (operacao == 9) {
+      analisar_rebanho(dados);
+    } else if (operacao == 10) {
+      buscar_animais(dados);
+    } else if (operacao == 11) {
+      listar_avaliacoes(dados);
+    } else {                    // Qualquer outra operação fora de {1,...,11}, mostre a ajuda com as operações 
       printar_ajuda();
     }
   }
+}
+
+/**
+ * Uso: main [arquivo] [--ids-numericos] [--rubro-negra] [--indices]
+ * [--indice-de-avaliacoes]. Com --ids-numericos os ids são guardados e
+ * ordenados como números; com --rubro-negra os animais ficam numa árvore
+ * rubro-negra em vez da AVL; com --indices a busca da operação 10 usa
+ * índices de espécie, sexo e primeiro dia de monitoramento, que tornam cada
+ * inserção e remoção mais cara; com --indice-de-avaliacoes a operação 11 usa
+ * o índice das avaliações por data, que torna cada monitoramento mais caro
+*/
+int main(int argc, char *argv[]) {
+  std::string arquivo_de_entrada;
+
+  if (argc > 1) {
+    // Se colocou o nome de outro arquivo
+    arquivo_de_entrada = argv[1];
+  } else {
+    // Se não, use o arquivo padrão
+    arquivo_de_entrada = "fauna.txt";
+  }
+  bool ids_numericos = false;
+  bool rubro_negra = false;
+  IndicesDoAnimal indices;
+  for (int index = 2; index < argc; ++index) {
+    std::string opcao = argv[index];
+    ids_numericos = ids_numericos or opcao == "--ids-numericos";
+    rubro_negra = rubro_negra or opcao == "--rubro-negra";
+    if (opcao == "--indices") {
+      indices.por_valor = {EsquemaDoAnimal::Especie, EsquemaDoAnimal::Sexo};
+      indices.por_data = {EsquemaDoAnimal::PrimeiroDiaDeMonitoramento};
+    }
+    indices.avaliacoes_por_data =
+        indices.avaliacoes_por_data or opcao == "--indice-de-avaliacoes";
+  }
+  if (ids_numericos and rubro_negra) {
+    executar<BasicDados<std::uint64_t, ArmazenamentoRubroNegro>>(
+        arquivo_de_entrada, indices);
+  } else if (ids_numericos) {
+    executar<DadosNumericos>(arquivo_de_entrada, indices);
+  } else if (rubro_negra) {
+    executar<DadosRubroNegros>(arquivo_de_entrada, indices);
+  } else {
+    executar<Dados>(arquivo_de_entrada, indices);
+  }
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,353 @@
+#ifndef MEDIDAS_H
+#define MEDIDAS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include <utility>
+
+/**
+ * Dia de uma data que não pôde ser lida
+*/
+constexpr std::int32_t DiaDesconhecido =
+    std::numeric_limits<std::int32_t>::min();
+/**
+ * Medida que não pôde ser lida. Toda comparação com ela é falsa
+*/
+constexpr float MedidaDesconhecida = std::numeric_limits<float>::quiet_NaN();
+/**
+ * Valores da coluna de sangue coletado
+*/
+enum ColetaDeSangue : std::int8_t {
+  ColetaDesconhecida = -1,
+  SemColeta = 0,
+  ComColeta = 1
+};
+
+/**
+ * Texto sem os espaços do começo e do fim
+*/
+inline std::string_view sem_espacos(std::string_view texto) {
+  const char *espacos = " \t\r\n";
+  size_t inicio = texto.find_first_not_of(espacos);
+  if (inicio == std::string_view::npos) {
+    return {};
+  }
+  return texto.substr(inicio, texto.find_last_not_of(espacos) - inicio + 1);
+}
+
+/**
+ * Dias desde 01/01/1970 da data "dd/mm/aaaa" (dia e mês podem ter um
+ * dígito), ou DiaDesconhecido se o texto não for uma data válida
+*/
+inline std::int32_t ler_data(std::string_view texto) {
+  texto = sem_espacos(texto);
+  int partes[3] = {0, 0, 0};
+  int digitos[3] = {0, 0, 0};
+  int parte = 0;
+  for (char letra : texto) {
+    if (letra == '/' and parte < 2) {
+      ++parte;
+    } else if (letra >= '0' and letra <= '9' and digitos[parte] < 4) {
+      partes[parte] = partes[parte] * 10 + (letra - '0');
+      ++digitos[parte];
+    } else {
+      return DiaDesconhecido;
+    }
+  }
+  auto [dia, mes, ano] = partes;
+  if (parte != 2 or digitos[0] == 0 or digitos[1] == 0 or digitos[2] != 4 or
+      mes < 1 or mes > 12 or dia < 1) {
+    return DiaDesconhecido;
+  }
+  bool bissexto = (ano % 4 == 0 and ano % 100 != 0) or ano % 400 == 0;
+  const int dias_do_mes[12] = {31, bissexto ? 29 : 28, 31, 30, 31, 30,
+                               31, 31,                 30, 31, 30, 31};
+  if (dia > dias_do_mes[mes - 1]) {
+    return DiaDesconhecido;
+  }
+  // Conta os anos a partir de março, para o dia bissexto ficar no fim
+  ano -= mes <= 2;
+  int era = ano / 400; // ano >= 0: o texto tem 4 dígitos
+  int ano_da_era = ano - era * 400;
+  int dia_do_ano = (153 * (mes > 2 ? mes - 3 : mes + 9) + 2) / 5 + dia - 1;
+  int dia_da_era =
+      ano_da_era * 365 + ano_da_era / 4 - ano_da_era / 100 + dia_do_ano;
+  return era * 146097 + dia_da_era - 719468;
+}
+
+/**
+ * Se "texto" é "palavra" em qualquer caixa (só letras ASCII mudam de caixa)
+*/
+inline bool igual_sem_caixa(std::string_view texto, std::string_view palavra) {
+  if (texto.size() != palavra.size()) {
+    return false;
+  }
+  for (size_t index = 0; index < texto.size(); ++index) {
+    char letra = texto[index];
+    if (letra >= 'A' and letra <= 'Z') {
+      letra = letra - 'A' + 'a';
+    }
+    if (letra != palavra[index]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Número no começo do texto (aceitando vírgula decimal) e a unidade que vem
+ * depois dele, sem espaços. Converte sem alocar, pois roda em cada linha
+ * ingerida
+ * \return false se o texto não começa com um número
+*/
+inline bool ler_numero_e_unidade(std::string_view texto, float &numero,
+                                 std::string_view &unidade) {
+  texto = sem_espacos(texto);
+  size_t index = 0;
+  bool negativo = false;
+  if (index < texto.size() and (texto[index] == '-' or texto[index] == '+')) {
+    negativo = texto[index++] == '-';
+  }
+  double valor = 0;
+  double escala = 1; // 10^-(dígitos depois da vírgula)
+  bool tem_digito = false;
+  bool tem_ponto = false;
+  for (; index < texto.size(); ++index) {
+    char letra = texto[index];
+    if (letra >= '0' and letra <= '9') {
+      tem_digito = true;
+      valor = valor * 10 + (letra - '0');
+      if (tem_ponto) {
+        escala /= 10;
+      }
+    } else if ((letra == '.' or letra == ',') and !tem_ponto) {
+      tem_ponto = true;
+    } else {
+      break;
+    }
+  }
+  if (!tem_digito) {
+    return false;
+  }
+  numero = static_cast<float>(negativo ? -valor * escala : valor * escala);
+  unidade = sem_espacos(texto.substr(index));
+  return true;
+}
+
+/**
+ * Temperatura em °C: "32", "32C", "32 °C" ou, convertida, "90F"
+*/
+inline float ler_temperatura(std::string_view texto) {
+  float numero;
+  std::string_view unidade;
+  if (!ler_numero_e_unidade(texto, numero, unidade)) {
+    return MedidaDesconhecida;
+  }
+  if (unidade.empty() or igual_sem_caixa(unidade, "c") or
+      igual_sem_caixa(unidade, "°c") or igual_sem_caixa(unidade, "ºc")) {
+    return numero;
+  }
+  if (igual_sem_caixa(unidade, "f") or igual_sem_caixa(unidade, "°f") or
+      igual_sem_caixa(unidade, "ºf")) {
+    return (numero - 32) * 5 / 9;
+  }
+  return MedidaDesconhecida;
+}
+
+/**
+ * Peso em kg: "500kg", "440" (kg) ou "333g"
+*/
+inline float ler_peso(std::string_view texto) {
+  float numero;
+  std::string_view unidade;
+  if (!ler_numero_e_unidade(texto, numero, unidade)) {
+    return MedidaDesconhecida;
+  }
+  if (unidade.empty() or igual_sem_caixa(unidade, "kg")) {
+    return numero;
+  }
+  if (igual_sem_caixa(unidade, "g")) {
+    return numero / 1000;
+  }
+  return MedidaDesconhecida;
+}
+
+/**
+ * Altura em m: "1.5m", "0,3" (m), "50cm" ou "80mm"
+*/
+inline float ler_altura(std::string_view texto) {
+  float numero;
+  std::string_view unidade;
+  if (!ler_numero_e_unidade(texto, numero, unidade)) {
+    return MedidaDesconhecida;
+  }
+  if (unidade.empty() or igual_sem_caixa(unidade, "m")) {
+    return numero;
+  }
+  if (igual_sem_caixa(unidade, "cm")) {
+    return numero / 100;
+  }
+  if (igual_sem_caixa(unidade, "mm")) {
+    return numero / 1000;
+  }
+  return MedidaDesconhecida;
+}
+
+/**
+ * "sim" ou "nao" (também "não", "s" e "n", em qualquer caixa)
+*/
+inline ColetaDeSangue ler_sangue_coletado(std::string_view texto) {
+  texto = sem_espacos(texto);
+  if (igual_sem_caixa(texto, "sim") or igual_sem_caixa(texto, "s")) {
+    return ComColeta;
+  }
+  if (igual_sem_caixa(texto, "nao") or igual_sem_caixa(texto, "não") or
+      igual_sem_caixa(texto, "n")) {
+    return SemColeta;
+  }
+  return ColetaDesconhecida;
+}
+
+/**
+ * As medidas dos monitoramentos de um animal convertidas na ingestão, uma
+ * coluna contígua por medida: a linha i é o monitoramento i. As análises
+ * percorrem só as colunas que usam, sem ler texto. O que não pôde ser lido
+ * fica DiaDesconhecido, MedidaDesconhecida ou ColetaDesconhecida.
+ * Uma sexta coluna guarda as linhas em ordem de data, o histórico do animal,
+ * mantido a cada linha acrescentada.
+ * As seis colunas dividem um só bloco alocado, uma depois da outra, então
+ * cada animal paga uma alocação e três palavras pelas medidas
+*/
+class ColunasDeMonitoramento {
+public:
+  ColunasDeMonitoramento() = default;
+  ColunasDeMonitoramento(const ColunasDeMonitoramento &outras) {
+    reservar(outras.m_linhas);
+    copiar_colunas(outras);
+  }
+  ColunasDeMonitoramento(ColunasDeMonitoramento &&outras) noexcept
+      : m_bloco(std::move(outras.m_bloco)),
+        m_linhas(std::exchange(outras.m_linhas, 0)),
+        m_capacidade(std::exchange(outras.m_capacidade, 0)) {}
+  ColunasDeMonitoramento &operator=(ColunasDeMonitoramento outras) noexcept {
+    std::swap(m_bloco, outras.m_bloco);
+    std::swap(m_linhas, outras.m_linhas);
+    std::swap(m_capacidade, outras.m_capacidade);
+    return *this;
+  }
+
+  size_t size() const { return m_linhas; }
+
+  /// Data da avaliação, em dias desde 01/01/1970
+  const std::int32_t *dias() const { return coluna<std::int32_t>(0); }
+  /// °C
+  const float *temperaturas() const { return coluna<float>(1); }
+  /// kg
+  const float *pesos() const { return coluna<float>(2); }
+  /// m
+  const float *alturas() const { return coluna<float>(3); }
+  /// Um ColetaDeSangue por linha
+  const std::int8_t *sangue_coletado() const {
+    return coluna<std::int8_t>(5);
+  }
+  /**
+   * As linhas em ordem de data da avaliação; no mesmo dia, na ordem em que
+   * foram acrescentadas. As de data desconhecida vêm primeiro
+  */
+  const std::uint32_t *em_ordem_de_data() const {
+    return coluna<std::uint32_t>(4);
+  }
+  /**
+   * Linha da avaliação mais recente, em O(1), ou size() se nenhuma tem data
+   * conhecida
+  */
+  size_t ultima_avaliacao() const {
+    if (m_linhas == 0) {
+      return m_linhas;
+    }
+    size_t linha = em_ordem_de_data()[m_linhas - 1];
+    return dias()[linha] == DiaDesconhecido ? m_linhas : linha;
+  }
+
+  void clear() { m_linhas = 0; }
+
+  /**
+   * Garante espaço para "linhas" linhas, crescendo geometricamente, para que
+   * acrescentar não falhe no meio de uma linha
+  */
+  void reservar(size_t linhas) {
+    if (linhas <= m_capacidade) {
+      return;
+    }
+    ColunasDeMonitoramento maiores;
+    maiores.m_capacidade = std::max(linhas, 2 * m_capacidade);
+    maiores.m_bloco.reset(new std::byte[maiores.m_capacidade * BytesPorLinha]);
+    maiores.copiar_colunas(*this);
+    *this = std::move(maiores);
+  }
+
+  /**
+   * Converte e acrescenta uma linha com os textos do monitoramento
+  */
+  void acrescentar(std::string_view data, std::string_view temperatura,
+                   std::string_view peso, std::string_view altura,
+                   std::string_view sangue) {
+    reservar(m_linhas + 1);
+    coluna<std::int32_t>(0)[m_linhas] = ler_data(data);
+    coluna<float>(1)[m_linhas] = ler_temperatura(temperatura);
+    coluna<float>(2)[m_linhas] = ler_peso(peso);
+    coluna<float>(3)[m_linhas] = ler_altura(altura);
+    coluna<std::int8_t>(5)[m_linhas] = ler_sangue_coletado(sangue);
+    ordenar_ultima_linha();
+    ++m_linhas;
+  }
+
+private:
+  /// As cinco colunas de 4 bytes e a de 1 byte
+  static constexpr size_t BytesPorLinha = 5 * 4 + 1;
+
+  /**
+   * Início da coluna "indice": as colunas de 4 bytes vêm primeiro, para que
+   * todas fiquem alinhadas
+  */
+  template <typename Tipo> Tipo *coluna(size_t indice) const {
+    return reinterpret_cast<Tipo *>(m_bloco.get() + indice * 4 * m_capacidade);
+  }
+  /// Copia as linhas de "origem", que cabem neste bloco
+  void copiar_colunas(const ColunasDeMonitoramento &origem) {
+    m_linhas = origem.m_linhas;
+    std::copy_n(origem.dias(), m_linhas, coluna<std::int32_t>(0));
+    std::copy_n(origem.temperaturas(), m_linhas, coluna<float>(1));
+    std::copy_n(origem.pesos(), m_linhas, coluna<float>(2));
+    std::copy_n(origem.alturas(), m_linhas, coluna<float>(3));
+    std::copy_n(origem.em_ordem_de_data(), m_linhas, coluna<std::uint32_t>(4));
+    std::copy_n(origem.sangue_coletado(), m_linhas, coluna<std::int8_t>(5));
+  }
+  /**
+   * Põe a linha m_linhas, já escrita, no seu lugar da ordem de data. As
+   * avaliações costumam chegar em ordem, e então ela só vai para o fim
+  */
+  void ordenar_ultima_linha() {
+    const std::int32_t *dia = dias();
+    std::uint32_t *ordem = coluna<std::uint32_t>(4);
+    std::uint32_t *lugar = ordem + m_linhas;
+    if (m_linhas > 0 and dia[m_linhas] < dia[ordem[m_linhas - 1]]) {
+      lugar = std::upper_bound(ordem, ordem + m_linhas, dia[m_linhas],
+                               [dia](std::int32_t novo, std::uint32_t linha) {
+                                 return novo < dia[linha];
+                               });
+      std::copy_backward(lugar, ordem + m_linhas, ordem + m_linhas + 1);
+    }
+    *lugar = static_cast<std::uint32_t>(m_linhas);
+  }
+
+  std::unique_ptr<std::byte[]> m_bloco;
+  size_t m_linhas{0};
+  size_t m_capacidade{0};
+};
+
+#endif // #ifndef MEDIDAS_H
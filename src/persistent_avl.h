@@ -0,0 +1,493 @@
+#ifndef PERSISTENT_AVL_H
+#define PERSISTENT_AVL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "tree_stats.h"
+
+/**
+ * Persistent AVL tree mapping unique keys to data: copying it is O(1) and
+ * the copy is a frozen snapshot that shares every node with the original.
+ *
+ * Nodes are reference counted (std::shared_ptr) and a write copies only the
+ * path from the root to the changed node, leaving the nodes other versions
+ * can see untouched. Nodes created since the tree was last copied are seen by
+ * this version alone, so writes change those in place instead of copying
+ * them again, and a run of writes between two snapshots costs about as much
+ * as in AVL. A version's nodes are freed when the last copy holding them is
+ * destroyed.
+ *
+ * A tree must not be written and copied from different threads at once, but
+ * once made, a copy may be read from any thread while the original keeps
+ * being written: none of its nodes will change.
+ * \tparam Compare strict weak ordering of the keys. A transparent one, such as
+ *         std::less<>, lets the lookups take any type comparable with KeyType.
+ */
+template <typename KeyType, typename DataType,
+          typename Compare = std::less<KeyType>>
+class PersistentAVL {
+public:
+  class const_iterator;
+  /// Elements are read-only through iterators; write through the tree.
+  using iterator = const_iterator;
+  struct node;
+  using node_pointer = std::shared_ptr<node>;
+
+  struct node {
+    const KeyType first;
+    DataType second;
+    node_pointer left_child;
+    node_pointer right_child;
+    int height{1};
+    size_t subtree_size{1};
+    std::uint64_t epoch; //!< Version of the tree that created it.
+
+    template <typename Key, typename... Args>
+    node(std::uint64_t epoch, Key &&key, Args &&...args)
+        : first(std::forward<Key>(key)), second(std::forward<Args>(args)...),
+          epoch(epoch) {}
+    /// Copy of "other" owned by the version "epoch".
+    node(const node &other, std::uint64_t epoch)
+        : first(other.first), second(other.second),
+          left_child(other.left_child), right_child(other.right_child),
+          height(other.height), subtree_size(other.subtree_size),
+          epoch(epoch) {}
+  };
+
+  PersistentAVL() = default;
+  /**
+   * Snapshot of "other" in O(1). From now on, neither tree changes the nodes
+   * they share.
+   */
+  PersistentAVL(const PersistentAVL &other)
+      : m_root(other.m_root), m_compare(other.m_compare) {
+    other.m_epoch = new_epoch();
+  }
+  PersistentAVL(PersistentAVL &&other) noexcept
+      : m_root(std::move(other.m_root)), m_epoch(other.m_epoch),
+        m_compare(std::move(other.m_compare)) {
+    other.m_epoch = new_epoch();
+  }
+  PersistentAVL &operator=(const PersistentAVL &other) {
+    if (this != &other) {
+      m_root = other.m_root;
+      m_compare = other.m_compare;
+      m_epoch = new_epoch();
+      other.m_epoch = new_epoch();
+    }
+    return *this;
+  }
+  PersistentAVL &operator=(PersistentAVL &&other) noexcept {
+    if (this != &other) {
+      m_root = std::move(other.m_root);
+      m_compare = std::move(other.m_compare);
+      m_epoch = other.m_epoch;
+      other.m_epoch = new_epoch();
+    }
+    return *this;
+  }
+
+  /// Frozen copy of the current version, in O(1).
+  PersistentAVL snapshot() const { return *this; }
+
+  /**
+   * If "key" is not in the tree, inserts it with data constructed from
+   * "args", copying the nodes on its path that other versions share.
+   * \return whether it was inserted.
+   */
+  template <typename Key, typename... Args>
+  bool try_emplace(Key &&key, Args &&...args) {
+    bool inserted = false;
+    m_root = insert_helper(m_root, inserted, std::forward<Key>(key),
+                           std::forward<Args>(args)...);
+    return inserted;
+  }
+
+  /**
+   * Inserts "key" with "data", or replaces the data of the element that
+   * already has that key.
+   * \return whether it was inserted.
+   */
+  template <typename Key, typename Data>
+  bool insert_or_assign(Key &&key, Data &&data) {
+    if (update(key,
+               [&data](DataType &old) { old = std::forward<Data>(data); })) {
+      return false;
+    }
+    return try_emplace(std::forward<Key>(key), std::forward<Data>(data));
+  }
+
+  /**
+   * Calls "function" with a reference to the data of "key", after copying
+   * the nodes on its path that other versions share, so the change is only
+   * seen by this version.
+   * \return whether the key was found.
+   */
+  template <typename Key, typename Function>
+  bool update(const Key &key, Function function) {
+    if (not contains(key)) {
+      return false;
+    }
+    node *target = nullptr;
+    m_root = update_helper(m_root, key, target);
+    function(target->second);
+    return true;
+  }
+
+  /**
+   * Removes the element whose key is equivalent to "key", if any.
+   * \return whether it was removed.
+   */
+  template <typename Key> bool erase(const Key &key) {
+    bool erased = false;
+    m_root = erase_helper(m_root, key, erased);
+    return erased;
+  }
+
+  /**
+   * Replaces the contents of the tree with the elements of [first, last),
+   * which must be sorted by strictly increasing key, in linear time.
+   */
+  template <typename ForwardIt>
+  void build_from_sorted(ForwardIt first, ForwardIt last) {
+    m_root = build_helper(first, std::distance(first, last));
+  }
+
+  void clear() { m_root = nullptr; }
+
+  /// Element whose key is equivalent to "key", or end() if there is none.
+  template <typename Key> const_iterator find(const Key &key) const {
+    const_iterator it = lower_bound(key);
+    if (it == end() or m_compare(key, it->first)) {
+      return end();
+    }
+    return it;
+  }
+  template <typename Key> bool contains(const Key &key) const {
+    for (const node *runner = m_root.get(); runner != nullptr;) {
+      if (m_compare(key, runner->first)) {
+        runner = runner->left_child.get();
+      } else if (m_compare(runner->first, key)) {
+        runner = runner->right_child.get();
+      } else {
+        return true;
+      }
+    }
+    return false;
+  }
+  /// First element whose key is not less than "key", or end().
+  template <typename Key> const_iterator lower_bound(const Key &key) const {
+    const_iterator it;
+    for (const node *runner = m_root.get(); runner != nullptr;) {
+      if (m_compare(runner->first, key)) {
+        runner = runner->right_child.get();
+      } else {
+        it.m_path.push_back(runner);
+        runner = runner->left_child.get();
+      }
+    }
+    return it;
+  }
+  /// First element whose key is greater than "key", or end().
+  template <typename Key> const_iterator upper_bound(const Key &key) const {
+    const_iterator it;
+    for (const node *runner = m_root.get(); runner != nullptr;) {
+      if (m_compare(key, runner->first)) {
+        it.m_path.push_back(runner);
+        runner = runner->left_child.get();
+      } else {
+        runner = runner->right_child.get();
+      }
+    }
+    return it;
+  }
+
+  const_iterator begin() const {
+    const_iterator it;
+    it.push_leftmost(m_root.get());
+    return it;
+  }
+  const_iterator end() const { return const_iterator(); }
+
+  bool empty() const { return m_root == nullptr; }
+  size_t size() const { return count(m_root); }
+  size_t height() const { return height_of(m_root); }
+
+  /**
+   * Checks every invariant in one O(n) traversal: key order, stored heights
+   * within one of each other and subtree sizes. The same traversal gathers
+   * the shape of the tree.
+   */
+  tree::TreeStats validate() const {
+    tree::TreeStats stats;
+    const node *previous = nullptr; // last node visited in order
+    validate_helper(m_root.get(), 0, stats, previous);
+    return stats;
+  }
+
+  /**
+   * Forward iterator over the elements in key order. Dereferencing gives the
+   * data; the arrow gives the node, so "it->first" is the key. It keeps the
+   * path from the root, so it is valid while the version it came from is not
+   * written to; iterate a snapshot to keep writing meanwhile.
+   */
+  class const_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = DataType;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const node *;
+    using reference = const DataType &;
+
+    const_iterator() = default;
+
+    friend bool operator==(const const_iterator &lhs,
+                           const const_iterator &rhs) {
+      return lhs.current() == rhs.current();
+    }
+    friend bool operator!=(const const_iterator &lhs,
+                           const const_iterator &rhs) {
+      return !(lhs == rhs);
+    }
+    reference operator*() const { return current()->second; }
+    pointer operator->() const { return current(); }
+    const_iterator &operator++() {
+      const node *visited = m_path.back();
+      m_path.pop_back();
+      push_leftmost(visited->right_child.get());
+      return *this;
+    }
+    const_iterator operator++(int) {
+      const_iterator copy = *this;
+      ++(*this);
+      return copy;
+    }
+
+  private:
+    friend class PersistentAVL;
+
+    const node *current() const {
+      return m_path.empty() ? nullptr : m_path.back();
+    }
+    void push_leftmost(const node *runner) {
+      for (; runner != nullptr; runner = runner->left_child.get()) {
+        m_path.push_back(runner);
+      }
+    }
+
+    /// Nodes whose left subtree is being visited; the last one is current.
+    std::vector<const node *> m_path;
+  };
+
+private:
+  static std::uint64_t new_epoch() {
+    static std::atomic<std::uint64_t> next{1};
+    return next.fetch_add(1, std::memory_order_relaxed);
+  }
+  static size_t count(const node_pointer &root) {
+    return root != nullptr ? root->subtree_size : 0;
+  }
+  static int height_of(const node_pointer &root) {
+    return root != nullptr ? root->height : 0;
+  }
+  /// Recomputes the height and size of "root" from its children.
+  static void update_node(node *root) {
+    root->height =
+        std::max(height_of(root->left_child), height_of(root->right_child)) + 1;
+    root->subtree_size =
+        count(root->left_child) + count(root->right_child) + 1;
+  }
+  /**
+   * "root" itself if this version created it after its last copy, otherwise
+   * a copy of it this version can change.
+   */
+  node_pointer own(const node_pointer &root) const {
+    if (root->epoch == m_epoch) {
+      return root;
+    }
+    return std::make_shared<node>(*root, m_epoch);
+  }
+  template <typename Key, typename... Args>
+  node_pointer insert_helper(const node_pointer &root, bool &inserted,
+                             Key &&key, Args &&...args) {
+    if (root == nullptr) {
+      inserted = true;
+      return std::make_shared<node>(m_epoch, std::forward<Key>(key),
+                                    std::forward<Args>(args)...);
+    }
+    bool to_left = m_compare(key, root->first);
+    if (not to_left and not m_compare(root->first, key)) {
+      return root; // the key is already in the tree
+    }
+    const node_pointer &child = to_left ? root->left_child : root->right_child;
+    node_pointer new_child = insert_helper(
+        child, inserted, std::forward<Key>(key), std::forward<Args>(args)...);
+    if (not inserted) {
+      return root;
+    }
+    node_pointer new_root = own(root);
+    (to_left ? new_root->left_child : new_root->right_child) =
+        std::move(new_child);
+    return rebalance(std::move(new_root));
+  }
+  /// Owns the path to "key", which must be in the tree, and finds its node.
+  template <typename Key>
+  node_pointer update_helper(const node_pointer &root, const Key &key,
+                             node *&target) {
+    node_pointer new_root = own(root);
+    if (m_compare(key, root->first)) {
+      new_root->left_child = update_helper(root->left_child, key, target);
+    } else if (m_compare(root->first, key)) {
+      new_root->right_child = update_helper(root->right_child, key, target);
+    } else {
+      target = new_root.get();
+    }
+    return new_root;
+  }
+  template <typename Key>
+  node_pointer erase_helper(const node_pointer &root, const Key &key,
+                            bool &erased) {
+    if (root == nullptr) {
+      return nullptr;
+    }
+    if (m_compare(key, root->first) or m_compare(root->first, key)) {
+      bool to_left = m_compare(key, root->first);
+      const node_pointer &child =
+          to_left ? root->left_child : root->right_child;
+      node_pointer new_child = erase_helper(child, key, erased);
+      if (not erased) {
+        return root;
+      }
+      node_pointer new_root = own(root);
+      (to_left ? new_root->left_child : new_root->right_child) =
+          std::move(new_child);
+      return rebalance(std::move(new_root));
+    }
+    erased = true;
+    if (root->left_child == nullptr) {
+      return root->right_child;
+    }
+    if (root->right_child == nullptr) {
+      return root->left_child;
+    }
+    // The successor leaves the right subtree and takes the removed place
+    node_pointer successor;
+    node_pointer right = remove_min(root->right_child, successor);
+    node_pointer new_root = own(successor);
+    new_root->left_child = root->left_child;
+    new_root->right_child = std::move(right);
+    return rebalance(std::move(new_root));
+  }
+  /// Removes the smallest node of "root", handing it in "min".
+  node_pointer remove_min(const node_pointer &root, node_pointer &min) {
+    if (root->left_child == nullptr) {
+      min = root;
+      return root->right_child;
+    }
+    node_pointer new_child = remove_min(root->left_child, min);
+    node_pointer new_root = own(root);
+    new_root->left_child = std::move(new_child);
+    return rebalance(std::move(new_root));
+  }
+  /**
+   * Updates "root", which this version owns, and fixes it with one or two
+   * rotations if its subtrees' heights differ by two.
+   * \return the new root of the subtree.
+   */
+  node_pointer rebalance(node_pointer root) {
+    int difference = height_of(root->right_child) - height_of(root->left_child);
+    if (difference > 1) {
+      if (height_of(root->right_child->left_child) >
+          height_of(root->right_child->right_child)) {
+        root->right_child = right_rotation(own(root->right_child));
+      }
+      return left_rotation(std::move(root));
+    }
+    if (difference < -1) {
+      if (height_of(root->left_child->right_child) >
+          height_of(root->left_child->left_child)) {
+        root->left_child = left_rotation(own(root->left_child));
+      }
+      return right_rotation(std::move(root));
+    }
+    update_node(root.get());
+    return root;
+  }
+  node_pointer left_rotation(node_pointer root) {
+    node_pointer new_root = own(root->right_child);
+    root->right_child = new_root->left_child;
+    update_node(root.get());
+    new_root->left_child = std::move(root);
+    update_node(new_root.get());
+    return new_root;
+  }
+  node_pointer right_rotation(node_pointer root) {
+    node_pointer new_root = own(root->left_child);
+    root->left_child = new_root->right_child;
+    update_node(root.get());
+    new_root->right_child = std::move(root);
+    update_node(new_root.get());
+    return new_root;
+  }
+  /**
+   * Builds a subtree from the next "count" elements of "first", taking the
+   * middle one as its root.
+   */
+  template <typename ForwardIt>
+  node_pointer build_helper(ForwardIt &first, size_t count) {
+    if (count == 0) {
+      return nullptr;
+    }
+    node_pointer left = build_helper(first, (count - 1) / 2);
+    auto &&element = *first;
+    node_pointer root = std::make_shared<node>(
+        m_epoch, std::get<0>(std::forward<decltype(element)>(element)),
+        std::get<1>(std::forward<decltype(element)>(element)));
+    ++first;
+    root->left_child = std::move(left);
+    root->right_child = build_helper(first, count / 2);
+    update_node(root.get());
+    return root;
+  }
+  /// Checks the subtree rooted at "root", at "depth", after "previous".
+  void validate_helper(const node *root, size_t depth, tree::TreeStats &stats,
+                       const node *&previous) const {
+    if (root == nullptr) {
+      return;
+    }
+    stats.count_node(depth);
+    validate_helper(root->left_child.get(), depth + 1, stats, previous);
+    if (previous != nullptr and not m_compare(previous->first, root->first)) {
+      stats.fail("keys out of order");
+    }
+    previous = root;
+    validate_helper(root->right_child.get(), depth + 1, stats, previous);
+    int left = height_of(root->left_child);
+    int right = height_of(root->right_child);
+    if (root->height != std::max(left, right) + 1) {
+      stats.fail("wrong height");
+    }
+    if (right - left < -1 or right - left > 1) {
+      stats.fail("subtree heights differ by more than one");
+    }
+    if (root->subtree_size !=
+        count(root->left_child) + count(root->right_child) + 1) {
+      stats.fail("wrong subtree size");
+    }
+  }
+
+  node_pointer m_root;
+  /// Nodes with this epoch are seen by this version alone.
+  mutable std::uint64_t m_epoch{new_epoch()};
+  Compare m_compare;
+};
+
+#endif // #ifndef PERSISTENT_AVL_H
@@ -0,0 +1,275 @@
+#ifndef REDBLACKHOOK_H
+#define REDBLACKHOOK_H
+
+#include <cstdint>
+
+// Namespace for tree data-structures.
+namespace tree {
+/**
+ * Links of a red black tree node: the two children and the parent, whose
+ * pointer carries the color in its lowest bit. Hooks are aligned to at least
+ * two bytes, so that bit is always zero in a real address, and a node costs
+ * three pointers instead of three pointers plus a padded bool.
+ *
+ * Derive a record from it to link the record itself into an
+ * IntrusiveRedBlackTree, or use it as the base of a node type.
+ */
+class RedBlackHook {
+public:
+  RedBlackHook *left_child{nullptr};
+  RedBlackHook *right_child{nullptr};
+
+  RedBlackHook *parent() const {
+    return reinterpret_cast<RedBlackHook *>(m_parent_and_color & ~color_bit);
+  }
+  void set_parent(RedBlackHook *parent) {
+    m_parent_and_color =
+        reinterpret_cast<std::uintptr_t>(parent) | (m_parent_and_color & color_bit);
+  }
+  bool black() const { return m_parent_and_color & color_bit; }
+  void set_black(bool black) {
+    m_parent_and_color = (m_parent_and_color & ~color_bit) | black;
+  }
+
+private:
+  static constexpr std::uintptr_t color_bit = 1;
+  std::uintptr_t m_parent_and_color{0}; //!< Parent address | black.
+};
+static_assert(alignof(RedBlackHook) >= 2, "the color needs a free bit");
+static_assert(sizeof(RedBlackHook) == 3 * sizeof(void *),
+              "the color must not add padding");
+
+/**
+ * Red black tree algorithms over hooks, shared by the trees built on
+ * RedBlackHook. The tree owns a "header" hook whose left child is the root,
+ * so every node, the root included, has a parent and the header serves as
+ * end(). Nothing here compares keys or allocates.
+ */
+struct RedBlackAlgorithms {
+  /// Whether "node" is black; empty leaves (nullptr) are.
+  static bool is_black(const RedBlackHook *node) {
+    return node == nullptr or node->black();
+  }
+
+  /**
+   * Returns the in-order successor of "current"; the header follows the last
+   * node, as the root is its left child.
+   */
+  template <typename Hook> static Hook *successor(Hook *current) {
+    if (current->right_child != nullptr) {
+      current = current->right_child;
+      while (current->left_child != nullptr) {
+        current = current->left_child;
+      }
+      return current;
+    }
+    while (current == current->parent()->right_child) {
+      current = current->parent();
+    }
+    return current->parent();
+  }
+  /**
+   * Returns the in-order predecessor of "current"; from the header, this is
+   * the last node.
+   */
+  template <typename Hook> static Hook *predecessor(Hook *current) {
+    if (current->left_child != nullptr) {
+      current = current->left_child;
+      while (current->right_child != nullptr) {
+        current = current->right_child;
+      }
+      return current;
+    }
+    while (current == current->parent()->left_child) {
+      current = current->parent();
+    }
+    return current->parent();
+  }
+
+  /**
+   * Hangs the unlinked "node" as the left (or right) child of "parent",
+   * which may be the header for the root, and rebalances.
+   */
+  static void link(RedBlackHook *header, RedBlackHook *node,
+                   RedBlackHook *parent, bool left) {
+    node->left_child = nullptr;
+    node->right_child = nullptr;
+    node->set_parent(parent);
+    node->set_black(false);
+    if (left) {
+      parent->left_child = node;
+    } else {
+      parent->right_child = node;
+    }
+    insert_fixup(header, node);
+  }
+
+  /**
+   * Unlinks "target" from the tree under "header" and rebalances, recoloring
+   * and rotating at most three times. "target" is left untouched for the
+   * caller to destroy or reuse.
+   */
+  static void unlink(RedBlackHook *header, RedBlackHook *target) {
+    RedBlackHook *substitute = nullptr; // takes the place of the removed black
+    RedBlackHook *parent = nullptr;     // parent of "substitute"
+    bool removed_black = target->black();
+    if (target->left_child != nullptr and target->right_child != nullptr) {
+      // The successor leaves its place and takes the place and color of
+      // "target"
+      RedBlackHook *replacement = successor(target);
+      removed_black = replacement->black();
+      substitute = replacement->right_child;
+      if (replacement->parent() == target) {
+        parent = replacement;
+      } else {
+        parent = replacement->parent();
+        replace_child(replacement, substitute);
+        replacement->right_child = target->right_child;
+        replacement->right_child->set_parent(replacement);
+      }
+      replace_child(target, replacement);
+      replacement->left_child = target->left_child;
+      replacement->left_child->set_parent(replacement);
+      replacement->set_black(target->black());
+    } else {
+      substitute = target->left_child != nullptr ? target->left_child
+                                                 : target->right_child;
+      parent = target->parent();
+      replace_child(target, substitute);
+    }
+    if (removed_black) {
+      erase_fixup(header, substitute, parent);
+    }
+  }
+
+  /**
+   * Puts "substitute" (possibly nullptr) where "old" hangs from its parent.
+   */
+  static void replace_child(RedBlackHook *old, RedBlackHook *substitute) {
+    RedBlackHook *parent = old->parent();
+    if (old == parent->left_child) {
+      parent->left_child = substitute;
+    } else {
+      parent->right_child = substitute;
+    }
+    if (substitute != nullptr) {
+      substitute->set_parent(parent);
+    }
+  }
+
+  /*!
+   * Restores the red black properties after "node" was linked red: while its
+   * parent is also red, recolors when the uncle is red and moves the problem
+   * two levels up, otherwise rotates once or twice and stops.
+   */
+  static void insert_fixup(RedBlackHook *header, RedBlackHook *node) {
+    while (node->parent() != header and not node->parent()->black()) {
+      RedBlackHook *parent = node->parent();
+      RedBlackHook *grandparent = parent->parent(); // a red parent is no root
+      bool parent_on_left = parent == grandparent->left_child;
+      RedBlackHook *uncle =
+          parent_on_left ? grandparent->right_child : grandparent->left_child;
+      if (not is_black(uncle)) {
+        parent->set_black(true);
+        uncle->set_black(true);
+        grandparent->set_black(false);
+        node = grandparent;
+        continue;
+      }
+      if (parent_on_left) {
+        if (node == parent->right_child) {
+          left_rotation(parent);
+          parent = node;
+        }
+        right_rotation(grandparent);
+      } else {
+        if (node == parent->left_child) {
+          right_rotation(parent);
+          parent = node;
+        }
+        left_rotation(grandparent);
+      }
+      parent->set_black(true);
+      grandparent->set_black(false);
+      break;
+    }
+    header->left_child->set_black(true);
+  }
+  /*!
+   * Restores the red black properties after a black node was removed from
+   * below "parent", leaving "node" (possibly nullptr) with one black too few
+   * on its paths.
+   */
+  static void erase_fixup(RedBlackHook *header, RedBlackHook *node,
+                          RedBlackHook *parent) {
+    while (parent != header and is_black(node)) {
+      bool on_left = node == parent->left_child;
+      RedBlackHook *sibling =
+          on_left ? parent->right_child : parent->left_child;
+      if (not sibling->black()) {
+        sibling->set_black(true);
+        parent->set_black(false);
+        if (on_left) {
+          left_rotation(parent);
+        } else {
+          right_rotation(parent);
+        }
+        sibling = on_left ? parent->right_child : parent->left_child;
+      }
+      RedBlackHook *near = on_left ? sibling->left_child : sibling->right_child;
+      RedBlackHook *far = on_left ? sibling->right_child : sibling->left_child;
+      if (is_black(near) and is_black(far)) {
+        sibling->set_black(false);
+        node = parent;
+        parent = node->parent();
+        continue;
+      }
+      if (is_black(far)) {
+        near->set_black(true);
+        sibling->set_black(false);
+        if (on_left) {
+          right_rotation(sibling);
+        } else {
+          left_rotation(sibling);
+        }
+        far = sibling;
+        sibling = near;
+      }
+      sibling->set_black(parent->black());
+      parent->set_black(true);
+      far->set_black(true);
+      if (on_left) {
+        left_rotation(parent);
+      } else {
+        right_rotation(parent);
+      }
+      return;
+    }
+    if (node != nullptr) {
+      node->set_black(true);
+    }
+  }
+  static void left_rotation(RedBlackHook *root) {
+    RedBlackHook *new_root = root->right_child;
+    replace_child(root, new_root);
+    root->set_parent(new_root);
+    root->right_child = new_root->left_child;
+    new_root->left_child = root;
+    if (root->right_child != nullptr) {
+      root->right_child->set_parent(root);
+    }
+  }
+  static void right_rotation(RedBlackHook *root) {
+    RedBlackHook *new_root = root->left_child;
+    replace_child(root, new_root);
+    root->set_parent(new_root);
+    root->left_child = new_root->right_child;
+    new_root->right_child = root;
+    if (root->left_child != nullptr) {
+      root->left_child->set_parent(root);
+    }
+  }
+};
+} // namespace tree
+
+#endif // #ifndef REDBLACKHOOK_H
@@ -2,20 +2,39 @@
 #define REDBLACKTREE_H
 
 #include <cstddef> // size_t, ptrdiff_t
-#include <cstdlib> //abs
+#include <functional> // less
+#include <future>     // async
 #include <initializer_list>
+#include <limits>
+#include <memory> // allocator, allocator_traits
+#include <thread> // hardware_concurrency
+#include <type_traits>
 #include <utility> // swap, move
 
+#include "slab_allocator.h"
+#include "tree_stats.h"
+
 // Namespace for tree data-structures.
 namespace tree {
 /*!
  * Red black tree, i.e. a self-balancing binary search tree. Important: does not
  * allows duplicate elements.
+ *
+ * The end of the tree is a sentinel node holding
+ * std::numeric_limits<T>::max(), created with the first element and kept as
+ * an ordinary (always largest) node of the tree until clear().
  * \tparam T data type to store.
+ * \tparam Compare strict weak ordering of the elements. A transparent one,
+ *         such as std::less<>, lets find, erase, lower_bound and upper_bound
+ *         take any type comparable with T.
+ * \tparam Allocator allocator rebound to allocate the nodes, e.g.
+ *         SlabAllocator to keep them contiguous.
  *
  * \author Eduardo Marinho (eduardo.nestor.marinho228@gmail.com)
  */
-template <typename T> class RedBlackTreeUnique {
+template <typename T, typename Compare = std::less<T>,
+          typename Allocator = std::allocator<T>>
+class RedBlackTreeUnique {
 public:
   //=== Forward declaration.
   class iterator;
@@ -34,8 +53,8 @@ public:
   struct Node {
     Node(value_type data, bool black = false, Node *parent = nullptr,
          Node *right_child = nullptr, Node *left_child = nullptr)
-        : data(data), black(black), parent(parent), right_child(right_child),
-          left_child(left_child) {}
+        : data(std::move(data)), black(black), parent(parent),
+          right_child(right_child), left_child(left_child) {}
 
     value_type data;
     bool black;
@@ -69,27 +88,62 @@ public:
     }
   }
   /*!
-   * Construct a clone of the red black tree "other".
-   * \param clone red black tree to be cloned.
+   * Construct a clone of the red black tree "other" in O(n), copying its shape
+   * and colors node by node instead of inserting each element again.
+   * \param other red black tree to be cloned.
    */
-  RedBlackTreeUnique(RedBlackTreeUnique &other) {
-    for (value_type value : other) {
-      insert(value);
+  RedBlackTreeUnique(const RedBlackTreeUnique &other)
+      : m_allocator(node_traits::select_on_container_copy_construction(
+            other.m_allocator)),
+        m_compare(other.m_compare) {
+    clone_from(other);
+  }
+  /*!
+   * Construct a red black tree that takes ownership of memory from "other",
+   * leaving it empty.
+   * \param other red black tree to take memory from.
+   */
+  RedBlackTreeUnique(RedBlackTreeUnique &&other) noexcept { swap(other); }
+  /*!
+   * Replaces the elements with a clone of the ones of "other", see the copy
+   * constructor. The nodes come from this tree's own allocator.
+   */
+  RedBlackTreeUnique &operator=(const RedBlackTreeUnique &other) {
+    if (this != &other) {
+      clear();
+      m_compare = other.m_compare;
+      clone_from(other);
     }
+    return *this;
   }
   /*!
-   * Construct a red black tree that takes ownership of memory from "source".
-   * \param source red black tree to take memory from.
+   * Releases the elements and takes the ones of "other" in O(1), leaving it
+   * empty. The allocator moves along with the nodes.
    */
-  RedBlackTreeUnique(RedBlackTreeUnique &&other) {
-    std::swap(m_size, other.m_size);
-    std::swap(m_root, other.m_root);
-    std::swap(m_smallest, other.m_smallest);
-    std::swap(m_end, other.m_end);
+  RedBlackTreeUnique &operator=(RedBlackTreeUnique &&other) noexcept {
+    if (this != &other) {
+      clear();
+      swap(other);
+    }
+    return *this;
   }
   /// Destructs the container, deallocating its memory.
   ~RedBlackTreeUnique() { clear(); }
 
+  /// Exchanges the elements (and allocators) of two trees in O(1).
+  void swap(RedBlackTreeUnique &other) noexcept {
+    using std::swap;
+    swap(m_size, other.m_size);
+    swap(m_root, other.m_root);
+    swap(m_smallest, other.m_smallest);
+    swap(m_end, other.m_end);
+    swap(m_allocator, other.m_allocator);
+    swap(m_compare, other.m_compare);
+  }
+  friend void swap(RedBlackTreeUnique &lhs, RedBlackTreeUnique &rhs) noexcept {
+    lhs.swap(rhs);
+  }
+
   ///=== [II] Iterators.
   /// Returns a iterator to the beginning of the container.
   iterator begin() { return iterator(m_smallest); }
@@ -108,7 +162,12 @@ public:
     if (m_root == nullptr) {
       return;
     }
-    clear_helper(&m_root);
+    if constexpr (std::is_trivially_destructible_v<Node> and
+                  releases_in_bulk<node_allocator>::value) {
+      m_allocator.release(); // drops whole slabs without visiting each node
+    } else {
+      clear_helper(m_root);
+    }
     m_root = nullptr;
     m_smallest = nullptr;
     m_end = nullptr;
@@ -116,53 +175,89 @@ public:
   }
   /*!
    * Inserts the element "value" in the container. If an element equivalent to
-   * "value" is already in the container does nothing. Uses the operator==(),
-   * operator<() and operator>().
+   * "value" is already in the container does nothing.
    * \param value data to insert.
-   * \return iterator pointing to inserted data.
+   * \return iterator pointing to inserted data, or to the equivalent element
+   *         already in the container.
    */
   iterator insert(value_type value) {
-    ++m_size;
-    iterator runner(m_root);
-    iterator parent;
+    if (m_root == nullptr) { // tree empty: the root and the end sentinel
+      m_root = create_node(std::move(value), true);
+      m_end = create_node(std::numeric_limits<value_type>::max(), false,
+                          m_root);
+      m_root->right_child = m_end;
+      m_smallest = m_root;
+      m_size = 1;
+      return iterator(m_root);
+    }
+    node_pointer parent = nullptr;
+    node_pointer runner = m_root;
     while (runner != nullptr) {
       parent = runner;
-      runner.next(value);
-    }
-    node_pointer new_node = new Node(value, false, &parent);
-    if (parent == nullptr) { // tree empty
-      m_root = new_node;
-      new_node->right_child =
-          new Node(std::numeric_limits<value_type>::max(), true, new_node);
-    } else if (value < *parent) {
-      (&parent)->left_child = new_node;
+      if (m_compare(value, runner->data)) {
+        runner = runner->left_child;
+      } else if (m_compare(runner->data, value)) {
+        runner = runner->right_child;
+      } else {
+        return iterator(runner);
+      }
+    }
+    return link_node(std::move(value), parent);
+  }
+  /*!
+   * Inserts the element "value" as close as possible to the position just
+   * before "hint", as std::set does. When "value" belongs right before or
+   * right after "hint" no descent from the root is made, so feeding values
+   * in order with the previous position (or end()) as the hint costs
+   * amortized O(1) per element.
+   * \param hint iterator to the element "value" should precede.
+   * \param value data to insert.
+   * \return iterator pointing to inserted data, or to the equivalent element
+   *         already in the container.
+   */
+  iterator insert(iterator hint, value_type value) {
+    node_pointer position = hint.m_pointer;
+    if (m_root == nullptr or position == nullptr) {
+      return insert(std::move(value));
+    }
+    node_pointer parent = nullptr; // where "value" hangs, if next to "hint"
+    if (m_compare(value, position->data)) {
+      if (position == m_smallest) {
+        parent = position;
+      } else {
+        node_pointer before = (--hint).m_pointer;
+        if (m_compare(before->data, value)) {
+          parent = before->right_child == nullptr ? before : position;
+        }
+      }
+    } else if (m_compare(position->data, value)) {
+      // "position" is not the sentinel, which is greater than any value
+      node_pointer after = (++hint).m_pointer;
+      if (m_compare(value, after->data)) {
+        parent = position->right_child == nullptr ? position : after;
+      }
     } else {
-      (&parent)->right_child = new_node;
+      return iterator(position);
     }
-
-    if (m_smallest == nullptr and m_end == nullptr) {
-      m_smallest = new_node;
-      m_end = new_node->right_child;
-    } else if (value >= *m_end) {
-      m_end = new_node;
-    } else if (value <= *m_smallest) {
-      m_smallest = new_node;
-    }
-    // insert_fixup(new_node); // TODO uncomment this
-    return iterator(new_node);
+    if (parent == nullptr) {
+      return insert(std::move(value));
+    }
+    return link_node(std::move(value), parent);
   }
   /*!
    * Removes an element equivalent to "key", if there are any, otherwise does
-   * nothing. Uses the operator==(), operator<() and operator>().
+   * nothing.
    * \param key element to remove.
    * \return iterator pointing to the element following the removed one.
    */
-  iterator erase(value_type key) {
-    iterator it = find(key);
-    if (it == m_end) {
-      return false;
-    }
-    return erase(it);
+  iterator erase(const_reference key) { return erase(find(key)); }
+  /// Same as above, for a key that need not be a value_type.
+  template <typename Key, typename C = Compare,
+            typename = typename C::is_transparent,
+            typename = std::enable_if_t<
+                not std::is_convertible_v<const Key &, iterator>>>
+  iterator erase(const Key &key) {
+    return erase(find(key));
   }
   /*!
    * Removes the element being pointed by the iterator "it".
@@ -170,109 +265,96 @@ public:
    * \return iterator pointing to the element following the removed one.
    */
   iterator erase(iterator it) {
-    if (it == nullptr or it == m_end) {
+    node_pointer target = it.m_pointer;
+    if (target == nullptr or target == m_end) {
       return end();
     }
-
-    if (it == m_smallest) {
-      if ((&m_smallest)->right_child != nullptr) {
-        m_smallest = (&m_smallest)->right_child;
-        while ((&m_smallest)->left_child != nullptr) {
-          m_smallest = (&m_smallest)->left_child;
-        }
-      } else {
-        m_smallest = it.get_parent();
-      }
-    }
-
-    Node *parent = &it.get_parent();
-    Node *substitute = (&it)->right_child;
-    Node *save = nullptr;
-    if (substitute != nullptr and substitute->left_child == nullptr) {
-      save = substitute;
-      substitute->parent = parent;
-      substitute->left_child = (&it)->left_child;
-      if ((&it)->left_child != nullptr) {
-        (&it)->left_child->parent = substitute;
-      }
-    } else if (substitute != nullptr) {
-      while (substitute->left_child != nullptr) {
-        substitute = substitute->left_child;
-      }
-      if (substitute->right_child != nullptr) {
-        substitute->right_child->parent = substitute->parent;
-        substitute->parent->left_child = substitute->right_child;
-      }
-      substitute->right_child = (&it)->right_child;
-      substitute->left_child = (&it)->left_child;
-      if ((&it)->right_child != nullptr) {
-        (&it)->right_child->parent = substitute;
-      }
-      if ((&it)->left_child != nullptr) {
-        (&it)->left_child->parent = substitute;
-      }
-      save = substitute;
-    } else if (parent == nullptr) {
-      m_root = (&it)->left_child;
-      if ((&it)->left_child != nullptr) {
-        (&it)->left_child->parent = nullptr;
-      } else {
-        m_smallest = m_end;
-      }
-    } else if ((&it)->left_child != nullptr) {
-      save = (&it)->left_child;
-      (&it)->left_child->parent = parent;
+    ++it; // the sentinel is the largest node, so there is always a successor
+    if (target == m_smallest) {
+      m_smallest = it.m_pointer;
     }
 
-    if (parent != nullptr) {
-      if (*it < parent->data) {
-        parent->left_child = save;
+    node_pointer substitute = nullptr; // takes the place of the removed black
+    node_pointer parent = nullptr;     // parent of "substitute"
+    bool removed_black = target->black;
+    if (target->left_child == nullptr) {
+      substitute = target->right_child;
+      parent = target->parent;
+      transplant(target, substitute);
+    } else if (target->right_child == nullptr) {
+      substitute = target->left_child;
+      parent = target->parent;
+      transplant(target, substitute);
+    } else {
+      // The successor leaves its place and takes the place and color of
+      // "target"
+      node_pointer successor = it.m_pointer;
+      removed_black = successor->black;
+      substitute = successor->right_child;
+      if (successor->parent == target) {
+        parent = successor;
       } else {
-        parent->right_child = save;
+        parent = successor->parent;
+        transplant(successor, substitute);
+        successor->right_child = target->right_child;
+        successor->right_child->parent = successor;
       }
+      transplant(target, successor);
+      successor->left_child = target->left_child;
+      successor->left_child->parent = successor;
+      successor->black = target->black;
     }
+    destroy_node(target);
     --m_size;
-    if (m_size == 0) {
-      m_root = m_smallest = m_end;
+    if (removed_black) {
+      erase_fixup(substitute, parent);
     }
-    delete &it;
-    return true;
+    return it;
   }
 
   ///=== [VI] Lookup.
   /*!
-   * Checks whether the tree is balanced.
-   * \return true if the left sub tree and the right sub tree is balanced and
-   *         their sizes do not differ by more than 1, otherwise false.
+   * Checks every invariant in one O(n) traversal: order, parent links, a
+   * black root, no red node with a red child, the same black height on every
+   * path, size() and the smallest and end nodes. The same traversal gathers
+   * the shape of the tree; the end sentinel is counted as a node.
+   * \return whether the invariants held, the first one broken and the shape.
    */
-  bool balanced() const {
-    if (m_root == nullptr) {
-      return true;
+  TreeStats validate() const {
+    TreeStats stats;
+    if (m_root != nullptr and not m_root->black) {
+      stats.fail("red root");
     }
-    return std::abs(subtree_size(m_root.m_pointer->left_child) -
-                    subtree_size(
-                        subtree_size(m_root.m_pointer->right_child))) <= 1 &&
-           balanced(m_root.m_pointer->left_child) &&
-           balanced(m_root.m_pointer->right_child);
+    if (m_root != nullptr and m_root->parent != nullptr) {
+      stats.fail("root with a parent");
+    }
+    const_node_pointer previous = nullptr; // last node visited in order
+    stats.black_height = validate_helper(m_root, nullptr, 0, stats, previous);
+    if (stats.node_count != (m_root != nullptr ? m_size + 1 : 0)) {
+      stats.fail("size() differs from the number of nodes");
+    }
+    if (previous != m_end) {
+      stats.fail("the end sentinel is not the largest node");
+    }
+    return stats;
   }
+  /*!
+   * Checks whether the tree keeps its red black invariants, see validate().
+   * \return true if the tree is a valid red black tree, otherwise false.
+   */
+  bool balanced() const { return validate().valid; }
   /*!
    * Returns an iterator pointing to an element equivalent to "key" or end() if
    * there is none.
    * \param key element to look for.
    * \return iterator pointing to element or end(), if not found.
    */
-  iterator find(const_reference key) {
-    iterator runner(m_root);
-    while (runner != nullptr) {
-      if (*runner < key) {
-        runner = (&runner)->right_child;
-      } else if (*runner > key) {
-        runner = (&runner)->left_child;
-      } else {
-        return runner;
-      }
-    }
-    return end();
+  iterator find(const_reference key) { return iterator(find_node(key)); }
+  /// Same as above, for a key that need not be a value_type.
+  template <typename Key, typename C = Compare,
+            typename = typename C::is_transparent>
+  iterator find(const Key &key) {
+    return iterator(find_node(key));
   }
   /*!
    * Returns an iterator pointing to the first element not less than "key".
@@ -281,17 +363,13 @@ public:
    *         end(), if there is none.
    */
   iterator lower_bound(const_reference key) {
-    iterator candidate = end();
-    iterator runner(m_root);
-    while (runner != nullptr) {
-      if (*runner >= key) {
-        candidate = runner;
-        runner = (&runner)->left_child;
-      } else {
-        runner = (&runner)->right_child;
-      }
-    }
-    return candidate;
+    return iterator(lower_bound_node(key));
+  }
+  /// Same as above, for a key that need not be a value_type.
+  template <typename Key, typename C = Compare,
+            typename = typename C::is_transparent>
+  iterator lower_bound(const Key &key) {
+    return iterator(lower_bound_node(key));
   }
   /*!
    * Returns an iterator pointing to the first element greater than "key".
@@ -300,17 +378,13 @@ public:
    *         if there is none.
    */
   iterator upper_bound(const_reference key) {
-    iterator candidate = end();
-    iterator runner(m_root);
-    while (runner != nullptr) {
-      if (*runner > key) {
-        candidate = runner;
-        runner = (&runner)->left_child;
-      } else {
-        runner = (&runner)->right_child;
-      }
-    }
-    return candidate;
+    return iterator(upper_bound_node(key));
+  }
+  /// Same as above, for a key that need not be a value_type.
+  template <typename Key, typename C = Compare,
+            typename = typename C::is_transparent>
+  iterator upper_bound(const Key &key) {
+    return iterator(upper_bound_node(key));
   }
 
   class iterator {
@@ -403,7 +477,7 @@ public:
     /// Goes to previous node and return a copy of this before operation.
     iterator operator--(int) {
       auto copy = m_pointer;
-      ++(*this);
+      --(*this);
       return iterator(copy);
     }
     /// Checks whether two iterators are equivalent.
@@ -443,10 +517,108 @@ public:
     }
 
   protected:
+    friend class RedBlackTreeUnique;
     Node *m_pointer; //!< Pointer to the node.
   };
 
 private:
+  using node_allocator =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+  using node_traits = std::allocator_traits<node_allocator>;
+
+  template <typename... Args> node_pointer create_node(Args &&...args) {
+    node_pointer new_node = node_traits::allocate(m_allocator, 1);
+    try {
+      node_traits::construct(m_allocator, new_node,
+                             std::forward<Args>(args)...);
+    } catch (...) {
+      node_traits::deallocate(m_allocator, new_node, 1);
+      throw;
+    }
+    return new_node;
+  }
+  void destroy_node(node_pointer node) {
+    node_traits::destroy(m_allocator, node);
+    node_traits::deallocate(m_allocator, node, 1);
+  }
+  /*!
+   * Makes this empty tree a copy of "other", node by node. Trees of at least
+   * "parallel_clone_size" elements copy their top subtrees in parallel when
+   * the allocator is stateless (e.g. std::allocator), and so safe to share
+   * between threads; a SlabAllocator pool is not, and is filled sequentially.
+   */
+  void clone_from(const RedBlackTreeUnique &other) {
+    if (other.m_root == nullptr) {
+      return;
+    }
+    size_t parallel_depth = 0; // levels whose left subtrees get their own task
+    if constexpr (node_traits::is_always_equal::value) {
+      if (other.m_size >= parallel_clone_size) {
+        for (unsigned tasks = std::thread::hardware_concurrency(); tasks > 1;
+             tasks /= 2) {
+          ++parallel_depth;
+        }
+      }
+    }
+    m_root = clone_helper(other.m_root, nullptr, parallel_depth);
+    m_size = other.m_size;
+    m_smallest = m_root;
+    while (m_smallest->left_child != nullptr) {
+      m_smallest = m_smallest->left_child;
+    }
+    m_end = m_root; // the sentinel is the largest node
+    while (m_end->right_child != nullptr) {
+      m_end = m_end->right_child;
+    }
+  }
+  /*!
+   * Copies the subtree rooted at "source", hanging the copy from "parent".
+   * While "parallel_depth" is positive, the left subtree is copied by another
+   * task while this one copies the right. If a copy throws, the nodes copied
+   * so far are destroyed.
+   * \return the root of the copy.
+   */
+  node_pointer clone_helper(const_node_pointer source, node_pointer parent,
+                            size_t parallel_depth) {
+    node_pointer root = create_node(source->data, source->black, parent);
+    node_pointer left = nullptr;
+    node_pointer right = nullptr;
+    try {
+      if (parallel_depth > 0 and source->left_child != nullptr) {
+        auto left_task = std::async(std::launch::async, [&] {
+          return clone_helper(source->left_child, root, parallel_depth - 1);
+        });
+        try {
+          if (source->right_child != nullptr) {
+            right = clone_helper(source->right_child, root, parallel_depth - 1);
+          }
+        } catch (...) {
+          left = left_task.get(); // the task must finish before unwinding
+          throw;
+        }
+        left = left_task.get();
+      } else {
+        if (source->left_child != nullptr) {
+          left = clone_helper(source->left_child, root, 0);
+        }
+        if (source->right_child != nullptr) {
+          right = clone_helper(source->right_child, root, 0);
+        }
+      }
+    } catch (...) {
+      if (left != nullptr) {
+        clear_helper(left);
+      }
+      if (right != nullptr) {
+        clear_helper(right);
+      }
+      destroy_node(root);
+      throw;
+    }
+    root->left_child = left;
+    root->right_child = right;
+    return root;
+  }
   void clear_helper(node_pointer node) {
     if (node->left_child != nullptr) {
       clear_helper(node->left_child);
@@ -454,45 +626,195 @@ private:
     if (node->right_child != nullptr) {
       clear_helper(node->right_child);
     }
-    delete node;
+    destroy_node(node);
+  }
+  /// Node equivalent to "key", or the end sentinel if there is none.
+  template <typename Key> node_pointer find_node(const Key &key) const {
+    node_pointer runner = m_root;
+    while (runner != nullptr) {
+      if (m_compare(runner->data, key)) {
+        runner = runner->right_child;
+      } else if (m_compare(key, runner->data)) {
+        runner = runner->left_child;
+      } else {
+        return runner;
+      }
+    }
+    return m_end;
+  }
+  /// First node not less than "key", or the end sentinel.
+  template <typename Key> node_pointer lower_bound_node(const Key &key) const {
+    node_pointer candidate = m_end;
+    node_pointer runner = m_root;
+    while (runner != nullptr) {
+      if (not m_compare(runner->data, key)) {
+        candidate = runner;
+        runner = runner->left_child;
+      } else {
+        runner = runner->right_child;
+      }
+    }
+    return candidate;
+  }
+  /// First node greater than "key", or the end sentinel.
+  template <typename Key> node_pointer upper_bound_node(const Key &key) const {
+    node_pointer candidate = m_end;
+    node_pointer runner = m_root;
+    while (runner != nullptr) {
+      if (m_compare(key, runner->data)) {
+        candidate = runner;
+        runner = runner->left_child;
+      } else {
+        runner = runner->right_child;
+      }
+    }
+    return candidate;
+  }
+  /*!
+   * Hangs a new red leaf holding "value" from "parent", on the side given by
+   * the order, and restores the red black properties.
+   */
+  iterator link_node(value_type &&value, node_pointer parent) {
+    node_pointer new_node = create_node(std::move(value), false, parent);
+    if (m_compare(new_node->data, parent->data)) {
+      parent->left_child = new_node;
+      if (parent == m_smallest) {
+        m_smallest = new_node;
+      }
+    } else {
+      parent->right_child = new_node;
+    }
+    ++m_size;
+    insert_fixup(new_node);
+    return iterator(new_node);
+  }
+  /// Whether "node" is black; empty leaves (nullptr) are.
+  static bool is_black(const_node_pointer node) {
+    return node == nullptr or node->black;
+  }
+  /*!
+   * Puts "substitute" (possibly nullptr) where "old" hangs from its parent.
+   */
+  void transplant(node_pointer old, node_pointer substitute) {
+    if (old->parent == nullptr) {
+      m_root = substitute;
+    } else if (old == old->parent->left_child) {
+      old->parent->left_child = substitute;
+    } else {
+      old->parent->right_child = substitute;
+    }
+    if (substitute != nullptr) {
+      substitute->parent = old->parent;
+    }
   }
-  // TODO fix this
+  /*!
+   * Restores the red black properties after "node" was inserted red: while its
+   * parent is also red, recolors when the uncle is red and moves the problem
+   * two levels up, otherwise rotates once or twice and stops.
+   */
   void insert_fixup(Node *node) {
-    if (node == m_root) {
-      node->black = true;
-      return;
+    while (node->parent != nullptr and not node->parent->black) {
+      Node *parent = node->parent;
+      Node *grandparent = parent->parent; // a red parent is never the root
+      if (parent == grandparent->left_child) {
+        Node *uncle = grandparent->right_child;
+        if (not is_black(uncle)) {
+          parent->black = true;
+          uncle->black = true;
+          grandparent->black = false;
+          node = grandparent;
+          continue;
+        }
+        if (node == parent->right_child) {
+          rotate_left(parent);
+          parent = node;
+        }
+        parent->black = true;
+        grandparent->black = false;
+        rotate_right(grandparent);
+        break;
+      } else {
+        Node *uncle = grandparent->left_child;
+        if (not is_black(uncle)) {
+          parent->black = true;
+          uncle->black = true;
+          grandparent->black = false;
+          node = grandparent;
+          continue;
+        }
+        if (node == parent->left_child) {
+          rotate_right(parent);
+          parent = node;
+        }
+        parent->black = true;
+        grandparent->black = false;
+        rotate_left(grandparent);
+        break;
+      }
     }
-    while (not node->parent->black) {
-      Node *aux = node->parent->parent;
-      if (aux != nullptr and node->parent == node->parent->parent->left_child) {
-        aux = node->parent->parent->right_child;
-        if (aux == nullptr or not aux->black) {
-          node->parent->black = true;
-          aux->black = true;
-          node->parent->parent->black = false;
-          node = node->parent->parent;
-        } else if (node == node->parent->right_child) {
-          node = node->parent;
-          rotate_left(node);
+    m_root->black = true;
+  }
+  /*!
+   * Restores the red black properties after a black node was removed from
+   * below "parent", leaving "node" (possibly nullptr) with one black too few
+   * on its paths.
+   */
+  void erase_fixup(Node *node, Node *parent) {
+    while (node != m_root and is_black(node)) {
+      if (node == parent->left_child) {
+        Node *sibling = parent->right_child; // has black height >= 1
+        if (not sibling->black) {
+          sibling->black = true;
+          parent->black = false;
+          rotate_left(parent);
+          sibling = parent->right_child;
+        }
+        if (is_black(sibling->left_child) and is_black(sibling->right_child)) {
+          sibling->black = false;
+          node = parent;
+          parent = node->parent;
+          continue;
+        }
+        if (is_black(sibling->right_child)) {
+          sibling->left_child->black = true;
+          sibling->black = false;
+          rotate_right(sibling);
+          sibling = parent->right_child;
         }
-        node->parent->black = true;
-        node->parent->parent->black = false;
+        sibling->black = parent->black;
+        parent->black = true;
+        sibling->right_child->black = true;
+        rotate_left(parent);
       } else {
-        aux = node->parent->parent->left_child;
-        if (aux == nullptr or not aux->black) {
-          node->parent->black = true;
-          aux->black = true;
-          node->parent->parent->black = false;
-          node = node->parent->parent;
-        } else if (node == node->parent->left_child) {
-          node = node->parent;
-          rotate_right(node);
+        Node *sibling = parent->left_child;
+        if (not sibling->black) {
+          sibling->black = true;
+          parent->black = false;
+          rotate_right(parent);
+          sibling = parent->left_child;
         }
-        node->parent->black = true;
-        node->parent->parent->black = false;
+        if (is_black(sibling->left_child) and is_black(sibling->right_child)) {
+          sibling->black = false;
+          node = parent;
+          parent = node->parent;
+          continue;
+        }
+        if (is_black(sibling->left_child)) {
+          sibling->right_child->black = true;
+          sibling->black = false;
+          rotate_left(sibling);
+          sibling = parent->left_child;
+        }
+        sibling->black = parent->black;
+        parent->black = true;
+        sibling->left_child->black = true;
+        rotate_right(parent);
       }
+      node = m_root;
+    }
+    if (node != nullptr) {
+      node->black = true;
     }
-    (&m_root)->black = true;
   }
   void rotate_left(Node *root) {
     Node *new_root = root->right_child;
@@ -528,27 +850,51 @@ private:
       root->left_child->parent = root;
     }
   }
-  bool balanced(iterator root) {
-    if (root == nullptr) {
-      return true;
-    }
-    return std::abs(subtree_size(root.m_pointer->left_child) -
-                    subtree_size(subtree_size(root.m_pointer->right_child))) <=
-               1 &&
-           balanced(root.m_pointer->left_child) &&
-           balanced(root.m_pointer->right_child);
-  }
-  size_type subtree_size(node_pointer root) {
+  /*!
+   * Checks the subtree rooted at "root", at "depth" and hanging from
+   * "parent", visiting it in order after "previous".
+   * \return its black height.
+   */
+  size_type validate_helper(const_node_pointer root, const_node_pointer parent,
+                            size_type depth, TreeStats &stats,
+                            const_node_pointer &previous) const {
     if (root == nullptr) {
       return 0;
     }
-    return subtree_size(root->left_child) + subtree_size(root->right_child) + 1;
+    stats.count_node(depth);
+    if (root->parent != parent) {
+      stats.fail("wrong parent link");
+    }
+    if (not root->black and
+        not (is_black(root->left_child) and is_black(root->right_child))) {
+      stats.fail("red node with a red child");
+    }
+    size_type left_black =
+        validate_helper(root->left_child, root, depth + 1, stats, previous);
+    if (previous == nullptr and root != m_smallest) {
+      stats.fail("the smallest node is not the leftmost one");
+    }
+    if (previous != nullptr and not m_compare(previous->data, root->data)) {
+      stats.fail("elements out of order");
+    }
+    previous = root;
+    size_type right_black =
+        validate_helper(root->right_child, root, depth + 1, stats, previous);
+    if (left_black != right_black) {
+      stats.fail("paths with different black heights");
+    }
+    return left_black + (root->black ? 1 : 0);
   }
 
-  size_type m_size{0}; //!< Number of elements in the tree.
-  iterator m_root;     //!< Iterator to the tree root.
-  iterator m_smallest; //!< Iterator to smallest element in the tree.
-  iterator m_end;      //!< Iterator to the end of the tree.
+  /// Trees at least this large may be cloned in parallel.
+  static constexpr size_type parallel_clone_size = size_type{1} << 16;
+
+  size_type m_size{0};           //!< Number of elements in the tree.
+  node_pointer m_root{nullptr};  //!< Tree root.
+  node_pointer m_smallest{nullptr}; //!< Smallest element in the tree.
+  node_pointer m_end{nullptr};   //!< End sentinel, the largest node.
+  node_allocator m_allocator;    //!< Allocates the nodes.
+  Compare m_compare;             //!< Orders the elements.
 };
 } // namespace tree
 
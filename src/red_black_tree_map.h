@@ -0,0 +1,629 @@
+#ifndef REDBLACKTREEMAP_H
+#define REDBLACKTREEMAP_H
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "red_black_hook.h"
+#include "slab_allocator.h"
+#include "tree_stats.h"
+
+// Namespace for tree data-structures.
+namespace tree {
+/**
+ * Red black tree mapping unique keys to values, stored inline in the nodes.
+ *
+ * Unlike RedBlackTreeUnique, the end of the tree is not a node holding a
+ * maximum value but a header owned by the tree: the root hangs as its left
+ * child, so incrementing the last element climbs to it and decrementing it
+ * descends to the last element. Any key type works, e.g. std::string.
+ * \tparam Compare strict weak ordering of the keys. A transparent one, such as
+ *         std::less<>, lets find, erase, contains, lower_bound and upper_bound
+ *         take any type comparable with Key.
+ * \tparam Allocator allocator rebound to allocate the nodes, e.g.
+ *         SlabAllocator to keep them contiguous.
+ */
+template <typename Key, typename Value, typename Compare = std::less<Key>,
+          typename Allocator = std::allocator<std::pair<const Key, Value>>>
+class RedBlackTreeMap {
+public:
+  template <bool Const> class basic_iterator;
+  using iterator = basic_iterator<false>;
+  using const_iterator = basic_iterator<true>;
+  using key_type = Key;
+  using mapped_type = Value;
+  using size_type = size_t;
+
+  /**
+   * Links and color of a node, packed in three pointers; the header is only
+   * this part.
+   */
+  using node_base = RedBlackHook;
+  struct node : node_base {
+    const Key first;
+    Value second;
+
+    /**
+     * Builds a red leaf hanging from "parent", constructing the key from
+     * "key" and the value from "args" in place.
+     */
+    template <typename K, typename... Args>
+    node(node_base *parent, K &&key, Args &&...args)
+        : first(std::forward<K>(key)), second(std::forward<Args>(args)...) {
+      set_parent(parent);
+    }
+  };
+
+  RedBlackTreeMap() = default;
+  RedBlackTreeMap(const RedBlackTreeMap &) = delete;
+  RedBlackTreeMap &operator=(const RedBlackTreeMap &) = delete;
+  ~RedBlackTreeMap() { clear(); }
+
+  /**
+   * Inserts a copy of "data" if its key is not in the tree yet.
+   * \return iterator to the element with that key and whether it was inserted.
+   */
+  std::pair<iterator, bool> insert(const std::pair<Key, Value> &data) {
+    return try_emplace(data.first, data.second);
+  }
+  /// Same as above, moving the key and the value into the new node.
+  std::pair<iterator, bool> insert(std::pair<Key, Value> &&data) {
+    return try_emplace(std::move(data.first), std::move(data.second));
+  }
+
+  /**
+   * If "key" is not in the tree, inserts it with a value constructed in place
+   * from "args"; otherwise leaves "key" and "args" untouched.
+   * \return iterator to the element with that key and whether it was inserted.
+   */
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const Key &key, Args &&...args) {
+    auto [parent, found] = insert_position(key);
+    if (found != nullptr) {
+      return {iterator(found), false};
+    }
+    node *new_node = create_node(parent, key, std::forward<Args>(args)...);
+    link_node(new_node, parent);
+    return {iterator(new_node), true};
+  }
+  /// Same as above, moving "key" into the node when it is inserted.
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(Key &&key, Args &&...args) {
+    auto [parent, found] = insert_position(key);
+    if (found != nullptr) {
+      return {iterator(found), false};
+    }
+    node *new_node =
+        create_node(parent, std::move(key), std::forward<Args>(args)...);
+    link_node(new_node, parent);
+    return {iterator(new_node), true};
+  }
+
+  /**
+   * Inserts a copy of "data" if its key is not in the tree yet, as close as
+   * possible to the position just before "hint", as std::map does. When the
+   * key belongs right before or right after "hint" no descent is made, so
+   * feeding keys in order with the previous position (or end()) as the hint
+   * costs amortized O(1) per element.
+   * \return iterator to the element with that key.
+   */
+  iterator insert(const_iterator hint, const std::pair<Key, Value> &data) {
+    return try_emplace(hint, data.first, data.second);
+  }
+  /// Same as above, moving the key and the value into the new node.
+  iterator insert(const_iterator hint, std::pair<Key, Value> &&data) {
+    return try_emplace(hint, std::move(data.first), std::move(data.second));
+  }
+
+  /**
+   * try_emplace starting next to "hint", see insert(hint, data).
+   * \return iterator to the element with that key.
+   */
+  template <typename... Args>
+  iterator try_emplace(const_iterator hint, const Key &key, Args &&...args) {
+    auto [parent, found] = insert_position(hint, key);
+    if (found != nullptr) {
+      return iterator(found);
+    }
+    node *new_node = create_node(parent, key, std::forward<Args>(args)...);
+    link_node(new_node, parent);
+    return iterator(new_node);
+  }
+  /// Same as above, moving "key" into the node when it is inserted.
+  template <typename... Args>
+  iterator try_emplace(const_iterator hint, Key &&key, Args &&...args) {
+    auto [parent, found] = insert_position(hint, key);
+    if (found != nullptr) {
+      return iterator(found);
+    }
+    node *new_node =
+        create_node(parent, std::move(key), std::forward<Args>(args)...);
+    link_node(new_node, parent);
+    return iterator(new_node);
+  }
+
+  /**
+   * Inserts "key" with "value", or assigns "value" to the element that already
+   * has that key.
+   * \return iterator to the element with that key and whether it was inserted.
+   */
+  template <typename V>
+  std::pair<iterator, bool> insert_or_assign(const Key &key, V &&value) {
+    auto result = try_emplace(key, std::forward<V>(value));
+    if (not result.second) {
+      result.first->second = std::forward<V>(value);
+    }
+    return result;
+  }
+  /// Same as above, moving "key" into the node when it is inserted.
+  template <typename V>
+  std::pair<iterator, bool> insert_or_assign(Key &&key, V &&value) {
+    auto result = try_emplace(std::move(key), std::forward<V>(value));
+    if (not result.second) {
+      result.first->second = std::forward<V>(value);
+    }
+    return result;
+  }
+
+  /**
+   * Replaces the contents of the tree with the elements of [first, last),
+   * which must be sorted by strictly increasing key. The tree is built
+   * bottom-up in linear time as a complete tree: every node is black except
+   * those on a partially filled last level, which are red leaves. Pass move
+   * iterators to move the elements into the nodes.
+   */
+  template <typename ForwardIt>
+  void build_from_sorted(ForwardIt first, ForwardIt last) {
+    clear();
+    m_size = std::distance(first, last);
+    int black_levels = 0; // levels that are completely filled
+    while ((size_t{2} << black_levels) - 1 <= m_size) {
+      ++black_levels;
+    }
+    m_header.left_child = build_helper(first, m_size, &m_header, black_levels);
+    m_begin = &m_header;
+    while (m_begin->left_child != nullptr) {
+      m_begin = m_begin->left_child;
+    }
+    m_last = m_size > 0 ? m_header.left_child : &m_header;
+    while (m_last->right_child != nullptr) {
+      m_last = m_last->right_child;
+    }
+  }
+
+  /// Removes the element whose key is equivalent to "key", if any.
+  void erase(const Key &key) {
+    iterator it = find(key);
+    if (it != end()) {
+      erase(it);
+    }
+  }
+  /// Same as above, for a key that need not be a Key.
+  template <typename K, typename C = Compare,
+            typename = typename C::is_transparent,
+            typename = std::enable_if_t<
+                not std::is_convertible_v<const K &, const_iterator>>>
+  void erase(const K &key) {
+    iterator it = find(key);
+    if (it != end()) {
+      erase(it);
+    }
+  }
+  /**
+   * Removes the element pointed by "it", recoloring and rotating at most three
+   * times from the splice point.
+   * \return iterator to the element following the removed one, or end() if it
+   *         was the last.
+   */
+  iterator erase(const_iterator it) {
+    node_base *target = const_cast<node_base *>(it.m_pointer);
+    node_base *next = RedBlackAlgorithms::successor(target);
+    if (target == m_begin) {
+      m_begin = next;
+    }
+    if (target == m_last) {
+      m_last = m_size == 1 ? &m_header
+                           : RedBlackAlgorithms::predecessor(target);
+    }
+    RedBlackAlgorithms::unlink(&m_header, target);
+    destroy_node(static_cast<node *>(target));
+    --m_size;
+    return iterator(next);
+  }
+  iterator erase(iterator it) { return erase(const_iterator(it)); }
+
+  iterator find(const Key &key) { return iterator(find_node(key)); }
+  const_iterator find(const Key &key) const {
+    return const_iterator(find_node(key));
+  }
+  /// Looks for a key equivalent to "key", which need not be a Key.
+  template <typename K, typename C = Compare,
+            typename = typename C::is_transparent>
+  iterator find(const K &key) {
+    return iterator(find_node(key));
+  }
+  template <typename K, typename C = Compare,
+            typename = typename C::is_transparent>
+  const_iterator find(const K &key) const {
+    return const_iterator(find_node(key));
+  }
+
+  /// Whether some key is equivalent to "key".
+  bool contains(const Key &key) const {
+    return insert_position(key).second != nullptr;
+  }
+  /// Same as above, for a key that need not be a Key.
+  template <typename K, typename C = Compare,
+            typename = typename C::is_transparent>
+  bool contains(const K &key) const {
+    return insert_position(key).second != nullptr;
+  }
+
+  /**
+   * First element whose key is not less than "key", or end() if there is
+   * none.
+   */
+  iterator lower_bound(const Key &key) {
+    return iterator(lower_bound_node(key));
+  }
+  const_iterator lower_bound(const Key &key) const {
+    return const_iterator(lower_bound_node(key));
+  }
+  template <typename K, typename C = Compare,
+            typename = typename C::is_transparent>
+  iterator lower_bound(const K &key) {
+    return iterator(lower_bound_node(key));
+  }
+  template <typename K, typename C = Compare,
+            typename = typename C::is_transparent>
+  const_iterator lower_bound(const K &key) const {
+    return const_iterator(lower_bound_node(key));
+  }
+
+  /**
+   * First element whose key is greater than "key", or end() if there is
+   * none.
+   */
+  iterator upper_bound(const Key &key) {
+    return iterator(upper_bound_node(key));
+  }
+  const_iterator upper_bound(const Key &key) const {
+    return const_iterator(upper_bound_node(key));
+  }
+  template <typename K, typename C = Compare,
+            typename = typename C::is_transparent>
+  iterator upper_bound(const K &key) {
+    return iterator(upper_bound_node(key));
+  }
+  template <typename K, typename C = Compare,
+            typename = typename C::is_transparent>
+  const_iterator upper_bound(const K &key) const {
+    return const_iterator(upper_bound_node(key));
+  }
+
+  iterator begin() { return iterator(m_begin); }
+  const_iterator begin() const { return const_iterator(m_begin); }
+  const_iterator cbegin() const { return begin(); }
+  /// Past-the-end iterator: the header node.
+  iterator end() { return iterator(&m_header); }
+  const_iterator end() const { return const_iterator(&m_header); }
+  const_iterator cend() const { return end(); }
+
+  bool empty() const { return m_size == 0; }
+  size_type size() const { return m_size; }
+
+  /**
+   * Checks every invariant in one O(n) traversal: key order, parent links,
+   * a black root, no red node with a red child, the same black height on
+   * every path, size(), begin() and the cached last node. The same traversal
+   * gathers the shape of the tree, so the stats show whether it degenerated.
+   */
+  tree::TreeStats validate() const {
+    tree::TreeStats stats;
+    const node_base *root = m_header.left_child;
+    if (root != nullptr and not root->black()) {
+      stats.fail("red root");
+    }
+    const node_base *previous = nullptr; // last node visited in order
+    stats.black_height = validate_helper(root, &m_header, 0, stats, previous);
+    if (stats.node_count != m_size) {
+      stats.fail("size() differs from the number of nodes");
+    }
+    if (previous == nullptr and m_begin != &m_header) {
+      stats.fail("begin() of an empty tree is not end()");
+    }
+    if (m_last != (previous != nullptr ? previous : &m_header)) {
+      stats.fail("cached last node is not the rightmost one");
+    }
+    return stats;
+  }
+
+  void clear() {
+    if (m_header.left_child == nullptr) {
+      return;
+    }
+    if constexpr (std::is_trivially_destructible_v<node> and
+                  releases_in_bulk<node_allocator>::value) {
+      m_allocator.release(); // drops whole slabs without visiting each node
+    } else {
+      clear_helper(m_header.left_child);
+    }
+    m_header.left_child = nullptr;
+    m_begin = &m_header;
+    m_last = &m_header;
+    m_size = 0;
+  }
+
+  /**
+   * Bidirectional iterator over the elements in key order. Dereferencing
+   * gives a reference to the value; the arrow gives the node, so "it->first"
+   * is the key and "it->second" the value.
+   * \tparam Const whether the elements are read-only through it.
+   */
+  template <bool Const> class basic_iterator {
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = Value;
+    using difference_type = std::ptrdiff_t;
+    using pointer = std::conditional_t<Const, const node *, node *>;
+    using reference = std::conditional_t<Const, const Value &, Value &>;
+
+    basic_iterator() = default;
+    /// An iterator converts to a const_iterator.
+    template <bool OtherConst,
+              typename = std::enable_if_t<Const and not OtherConst>>
+    basic_iterator(const basic_iterator<OtherConst> &other)
+        : m_pointer(other.m_pointer) {}
+
+    friend bool operator==(const basic_iterator &lhs,
+                           const basic_iterator &rhs) {
+      return lhs.m_pointer == rhs.m_pointer;
+    }
+    friend bool operator!=(const basic_iterator &lhs,
+                           const basic_iterator &rhs) {
+      return !(lhs == rhs);
+    }
+    reference operator*() const { return operator->()->second; }
+    pointer operator->() const { return static_cast<pointer>(m_pointer); }
+    basic_iterator &operator++() {
+      m_pointer = RedBlackAlgorithms::successor(m_pointer);
+      return *this;
+    }
+    basic_iterator operator++(int) {
+      basic_iterator copy = *this;
+      ++(*this);
+      return copy;
+    }
+    basic_iterator &operator--() {
+      m_pointer = RedBlackAlgorithms::predecessor(m_pointer);
+      return *this;
+    }
+    basic_iterator operator--(int) {
+      basic_iterator copy = *this;
+      --(*this);
+      return copy;
+    }
+
+  private:
+    friend class RedBlackTreeMap;
+    using base_pointer =
+        std::conditional_t<Const, const node_base *, node_base *>;
+
+    explicit basic_iterator(base_pointer pointer) : m_pointer(pointer) {}
+
+    base_pointer m_pointer{nullptr};
+  };
+
+private:
+  using node_allocator =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<node>;
+  using node_traits = std::allocator_traits<node_allocator>;
+
+  template <typename... Args> node *create_node(Args &&...args) {
+    node *new_node = node_traits::allocate(m_allocator, 1);
+    try {
+      node_traits::construct(m_allocator, new_node,
+                             std::forward<Args>(args)...);
+    } catch (...) {
+      node_traits::deallocate(m_allocator, new_node, 1);
+      throw;
+    }
+    return new_node;
+  }
+  void destroy_node(node *old) {
+    node_traits::destroy(m_allocator, old);
+    node_traits::deallocate(m_allocator, old, 1);
+  }
+  /**
+   * Builds a subtree from the next "count" elements of "first", taking the
+   * middle one as its root. Nodes deeper than "black_levels" levels are red.
+   * \return the root of the subtree.
+   */
+  template <typename ForwardIt>
+  node_base *build_helper(ForwardIt &first, size_t count, node_base *parent,
+                          int black_levels) {
+    if (count == 0) {
+      return nullptr;
+    }
+    node_base *left =
+        build_helper(first, (count - 1) / 2, nullptr, black_levels - 1);
+    auto &&element = *first;
+    node *root = create_node(
+        parent, std::get<0>(std::forward<decltype(element)>(element)),
+        std::get<1>(std::forward<decltype(element)>(element)));
+    ++first;
+    root->set_black(black_levels > 0);
+    root->left_child = left;
+    if (left != nullptr) {
+      left->set_parent(root);
+    }
+    root->right_child = build_helper(first, count / 2, root, black_levels - 1);
+    return root;
+  }
+  void clear_helper(node_base *node) {
+    if (node->left_child != nullptr) {
+      clear_helper(node->left_child);
+    }
+    if (node->right_child != nullptr) {
+      clear_helper(node->right_child);
+    }
+    destroy_node(static_cast<RedBlackTreeMap::node *>(node));
+  }
+  /**
+   * Checks the subtree rooted at "root", at "depth" and hanging from
+   * "parent", visiting it in order after "previous".
+   * \return its black height.
+   */
+  size_t validate_helper(const node_base *root, const node_base *parent,
+                         size_t depth, TreeStats &stats,
+                         const node_base *&previous) const {
+    if (root == nullptr) {
+      return 0;
+    }
+    stats.count_node(depth);
+    if (root->parent() != parent) {
+      stats.fail("wrong parent link");
+    }
+    if (not root->black() and
+        not (RedBlackAlgorithms::is_black(root->left_child) and
+             RedBlackAlgorithms::is_black(root->right_child))) {
+      stats.fail("red node with a red child");
+    }
+    size_t left_black =
+        validate_helper(root->left_child, root, depth + 1, stats, previous);
+    if (previous == nullptr and root != m_begin) {
+      stats.fail("begin() is not the leftmost node");
+    }
+    if (previous != nullptr and
+        not m_compare(static_cast<const node *>(previous)->first,
+                      static_cast<const node *>(root)->first)) {
+      stats.fail("keys out of order");
+    }
+    previous = root;
+    size_t right_black =
+        validate_helper(root->right_child, root, depth + 1, stats, previous);
+    if (left_black != right_black) {
+      stats.fail("paths with different black heights");
+    }
+    return left_black + (root->black() ? 1 : 0);
+  }
+  /// The header, also reachable from const members.
+  node_base *header() const { return const_cast<node_base *>(&m_header); }
+  /**
+   * Descends looking for "key".
+   * \return the node the key would hang from (the header for an empty tree)
+   *         and the node holding the key, or nullptr if there is none.
+   */
+  template <typename K>
+  std::pair<node_base *, node_base *> insert_position(const K &key) const {
+    node_base *runner = m_header.left_child;
+    node_base *parent = header();
+    while (runner != nullptr) {
+      if (m_compare(key, static_cast<node *>(runner)->first)) {
+        parent = runner;
+        runner = runner->left_child;
+      } else if (m_compare(static_cast<node *>(runner)->first, key)) {
+        parent = runner;
+        runner = runner->right_child;
+      } else {
+        return {parent, runner};
+      }
+    }
+    return {parent, nullptr};
+  }
+  /**
+   * Same as above, but first checks whether "key" belongs right before
+   * "hint" or right after it, where a leaf slot is always free; only
+   * otherwise descends from the root.
+   */
+  template <typename K>
+  std::pair<node_base *, node_base *> insert_position(const_iterator hint,
+                                                      const K &key) const {
+    node_base *position = const_cast<node_base *>(hint.m_pointer);
+    if (position == &m_header) {
+      if (m_size > 0 and m_compare(static_cast<node *>(m_last)->first, key)) {
+        return {m_last, nullptr}; // after the last element
+      }
+    } else if (m_compare(key, static_cast<node *>(position)->first)) {
+      if (position == m_begin) {
+        return {position, nullptr}; // before the first element
+      }
+      node_base *before = RedBlackAlgorithms::predecessor(position);
+      if (m_compare(static_cast<node *>(before)->first, key)) {
+        return {before->right_child == nullptr ? before : position, nullptr};
+      }
+    } else if (m_compare(static_cast<node *>(position)->first, key)) {
+      if (position == m_last) {
+        return {position, nullptr}; // after the last element
+      }
+      node_base *after = RedBlackAlgorithms::successor(position);
+      if (m_compare(key, static_cast<node *>(after)->first)) {
+        return {position->right_child == nullptr ? position : after, nullptr};
+      }
+    } else {
+      return {position->parent(), position};
+    }
+    return insert_position(key);
+  }
+  /// First node whose key is not less than "key", or the header.
+  template <typename K> node_base *lower_bound_node(const K &key) const {
+    node_base *candidate = header();
+    for (node_base *runner = m_header.left_child; runner != nullptr;) {
+      if (m_compare(static_cast<node *>(runner)->first, key)) {
+        runner = runner->right_child;
+      } else {
+        candidate = runner;
+        runner = runner->left_child;
+      }
+    }
+    return candidate;
+  }
+  /// First node whose key is greater than "key", or the header.
+  template <typename K> node_base *upper_bound_node(const K &key) const {
+    node_base *candidate = header();
+    for (node_base *runner = m_header.left_child; runner != nullptr;) {
+      if (m_compare(key, static_cast<node *>(runner)->first)) {
+        candidate = runner;
+        runner = runner->left_child;
+      } else {
+        runner = runner->right_child;
+      }
+    }
+    return candidate;
+  }
+  /// Node holding "key", or the header if there is none.
+  template <typename K> node_base *find_node(const K &key) const {
+    node_base *found = insert_position(key).second;
+    return found != nullptr ? found : header();
+  }
+  /**
+   * Hangs the leaf "new_node" from "parent" (the header for the root) and
+   * restores the red black properties.
+   */
+  void link_node(node *new_node, node_base *parent) {
+    ++m_size;
+    bool left = parent == &m_header or
+                m_compare(new_node->first, static_cast<node *>(parent)->first);
+    if (left and parent == m_begin) {
+      m_begin = new_node;
+    }
+    if (parent == &m_header or (not left and parent == m_last)) {
+      m_last = new_node;
+    }
+    RedBlackAlgorithms::link(&m_header, new_node, parent, left);
+  }
+
+  size_type m_size{0};
+  node_base m_header;            //!< Parent of the root and end() sentinel.
+  node_base *m_begin{&m_header}; //!< Leftmost node, or the header if empty.
+  node_base *m_last{&m_header};  //!< Rightmost node, or the header if empty.
+  node_allocator m_allocator;    //!< Allocates the nodes.
+  Compare m_compare;             //!< Orders the keys.
+};
+} // namespace tree
+
+#endif // #ifndef REDBLACKTREEMAP_H
@@ -0,0 +1,247 @@
+#ifndef SHARDEDTREE_H
+#define SHARDEDTREE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "tree_stats.h"
+
+// Namespace for tree data-structures.
+namespace tree {
+/**
+ * Splits the keys by hash across "Shards" independent trees, so that writes
+ * to different shards touch disjoint nodes and allocators and may run at the
+ * same time under one lock per shard. Point operations go to the shard of
+ * their key (shard_of, shard); whole-tree reads see one tree in key order
+ * through a k-way merge of the shards.
+ * \tparam Tree tree of each shard, with try_emplace, erase, contains,
+ *         lower_bound, upper_bound, begin, end, build_from_sorted, size and
+ *         validate, such as AVL or RedBlackTreeMap.
+ * \tparam Hash hashes the keys; it must give equal hashes for the key types
+ *         the lookups take, as std::hash does for std::string and
+ *         std::string_view.
+ * \tparam Compare the order of the keys in the shards.
+ */
+template <typename Tree, size_t Shards, typename Hash,
+          typename Compare = std::less<>>
+class ShardedTree {
+  static_assert(Shards > 0, "a sharded tree needs at least one shard");
+
+public:
+  class const_iterator;
+  using shard_type = Tree;
+  static constexpr size_t shard_count = Shards;
+
+  /// Index of the shard that holds "key".
+  template <typename Key> size_t shard_of(const Key &key) const {
+    return m_hash(key) % Shards;
+  }
+  Tree &shard(size_t index) { return m_shards[index]; }
+  const Tree &shard(size_t index) const { return m_shards[index]; }
+
+  /// try_emplace on the shard of "key".
+  template <typename Key, typename... Args>
+  auto try_emplace(Key &&key, Args &&...args) {
+    return m_shards[shard_of(key)].try_emplace(std::forward<Key>(key),
+                                               std::forward<Args>(args)...);
+  }
+  /// Removes the element whose key is equivalent to "key", if any.
+  template <typename Key> void erase(const Key &key) {
+    m_shards[shard_of(key)].erase(key);
+  }
+  template <typename Key> bool contains(const Key &key) const {
+    return m_shards[shard_of(key)].contains(key);
+  }
+
+  /**
+   * Replaces the contents with the elements of [first, last), sorted by
+   * strictly increasing key: each shard receives a sorted subsequence and the
+   * shards are built in linear time, in parallel.
+   */
+  template <typename ForwardIt>
+  void build_from_sorted(ForwardIt first, ForwardIt last) {
+    using element = typename std::iterator_traits<ForwardIt>::value_type;
+    std::vector<element> parts[Shards];
+    for (; first != last; ++first) {
+      auto &&value = *first;
+      size_t index = shard_of(std::get<0>(value));
+      parts[index].push_back(std::forward<decltype(value)>(value));
+    }
+    for_each_shard([this, &parts](size_t index) {
+      m_shards[index].build_from_sorted(
+          std::make_move_iterator(parts[index].begin()),
+          std::make_move_iterator(parts[index].end()));
+    });
+  }
+
+  /**
+   * Calls function(index) for every shard index, spreading the shards over
+   * up to one thread per core; a shard is only ever given to one thread.
+   * Rethrows the first exception thrown by a call.
+   */
+  template <typename Function> static void for_each_shard(Function function) {
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    size_t workers = std::min(Shards, cores);
+    auto worker = [&function, workers](size_t first) {
+      for (size_t index = first; index < Shards; index += workers) {
+        function(index);
+      }
+    };
+    std::vector<std::future<void>> others;
+    for (size_t first = 1; first < workers; ++first) {
+      others.push_back(std::async(std::launch::async, worker, first));
+    }
+    worker(0);
+    for (std::future<void> &other : others) {
+      other.get();
+    }
+  }
+
+  /// First element, in key order across the shards, not less than "key".
+  template <typename Key> const_iterator lower_bound(const Key &key) const {
+    return const_iterator(m_shards, [&key](const Tree &shard) {
+      return shard.lower_bound(key);
+    });
+  }
+  /// First element, in key order across the shards, greater than "key".
+  template <typename Key> const_iterator upper_bound(const Key &key) const {
+    return const_iterator(m_shards, [&key](const Tree &shard) {
+      return shard.upper_bound(key);
+    });
+  }
+  const_iterator begin() const {
+    return const_iterator(m_shards,
+                          [](const Tree &shard) { return shard.begin(); });
+  }
+  const_iterator end() const { return const_iterator(); }
+
+  size_t size() const {
+    size_t total = 0;
+    for (const Tree &shard : m_shards) {
+      total += shard.size();
+    }
+    return total;
+  }
+  bool empty() const { return size() == 0; }
+  void clear() {
+    for (Tree &shard : m_shards) {
+      shard.clear();
+    }
+  }
+
+  /**
+   * Validates every shard. The shapes add up depth by depth, so the average
+   * path length is that of a search once its shard is known; the height and
+   * black height are those of the tallest shard.
+   */
+  tree::TreeStats validate() const {
+    tree::TreeStats total;
+    for (const Tree &shard : m_shards) {
+      tree::TreeStats stats = shard.validate();
+      if (not stats.valid) {
+        total.fail(stats.error);
+      }
+      if (total.nodes_per_depth.size() < stats.nodes_per_depth.size()) {
+        total.nodes_per_depth.resize(stats.nodes_per_depth.size(), 0);
+      }
+      for (size_t depth = 0; depth < stats.nodes_per_depth.size(); ++depth) {
+        total.nodes_per_depth[depth] += stats.nodes_per_depth[depth];
+      }
+      total.node_count += stats.node_count;
+      total.height = std::max(total.height, stats.height);
+      total.black_height = std::max(total.black_height, stats.black_height);
+    }
+    return total;
+  }
+
+  /**
+   * Forward iterator merging the shards in key order: a min-heap keeps the
+   * current element of each shard, so an increment costs O(log Shards) key
+   * comparisons. Dereferencing and the arrow behave as in the shards.
+   */
+  class const_iterator {
+    using shard_iterator = typename Tree::const_iterator;
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = typename std::iterator_traits<shard_iterator>::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = typename std::iterator_traits<shard_iterator>::pointer;
+    using reference = typename std::iterator_traits<shard_iterator>::reference;
+
+    const_iterator() = default;
+
+    friend bool operator==(const const_iterator &lhs,
+                           const const_iterator &rhs) {
+      if (lhs.m_heap.empty() or rhs.m_heap.empty()) {
+        return lhs.m_heap.empty() == rhs.m_heap.empty();
+      }
+      return lhs.m_heap.front().current == rhs.m_heap.front().current;
+    }
+    friend bool operator!=(const const_iterator &lhs,
+                           const const_iterator &rhs) {
+      return !(lhs == rhs);
+    }
+    reference operator*() const { return *m_heap.front().current; }
+    pointer operator->() const {
+      return m_heap.front().current.operator->();
+    }
+    const_iterator &operator++() {
+      std::pop_heap(m_heap.begin(), m_heap.end(), later);
+      cursor &advanced = m_heap.back();
+      if (++advanced.current == advanced.end) {
+        m_heap.pop_back();
+      } else {
+        std::push_heap(m_heap.begin(), m_heap.end(), later);
+      }
+      return *this;
+    }
+    const_iterator operator++(int) {
+      const_iterator copy = *this;
+      ++(*this);
+      return copy;
+    }
+
+  private:
+    friend class ShardedTree;
+
+    /// Position in one shard and the end of that shard.
+    struct cursor {
+      shard_iterator current;
+      shard_iterator end;
+    };
+
+    /// Starts every shard at start(shard), skipping those already at end.
+    template <typename Start>
+    const_iterator(const Tree (&shards)[Shards], Start start) {
+      m_heap.reserve(Shards);
+      for (const Tree &shard : shards) {
+        shard_iterator current = start(shard);
+        if (current != shard.end()) {
+          m_heap.push_back({current, shard.end()});
+        }
+      }
+      std::make_heap(m_heap.begin(), m_heap.end(), later);
+    }
+    /// Heap order putting the smallest key at the front.
+    static bool later(const cursor &lhs, const cursor &rhs) {
+      return Compare()(rhs.current->first, lhs.current->first);
+    }
+
+    std::vector<cursor> m_heap;
+  };
+
+private:
+  Tree m_shards[Shards];
+  Hash m_hash;
+};
+} // namespace tree
+
+#endif // #ifndef SHARDEDTREE_H
@@ -0,0 +1,140 @@
+#ifndef SLAB_ALLOCATOR_H
+#define SLAB_ALLOCATOR_H
+
+#include <cstddef> // size_t
+#include <new>     // operator new, operator delete
+#include <type_traits>
+#include <utility> // swap, declval
+#include <vector>
+
+// Namespace for tree data-structures.
+namespace tree {
+/*!
+ * Allocator that hands out single objects from contiguous slabs of
+ * "SlabCapacity" slots. Freed slots are kept in a free list and recycled by
+ * the next allocation; the slabs themselves are only returned to the system
+ * by release() or by the destructor, one deallocation per slab.
+ *
+ * Every allocator owns its own pool, so copies start empty and two allocators
+ * compare equal only if they are the same object. Requests for more than one
+ * object fall back to the global operator new.
+ * \tparam T type of the objects to allocate.
+ * \tparam SlabCapacity number of objects per slab.
+ */
+template <typename T, size_t SlabCapacity = 1024> class SlabAllocator {
+public:
+  //=== Aliases.
+  using value_type = T;
+  using size_type = size_t;
+  using propagate_on_container_copy_assignment = std::false_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+  using is_always_equal = std::false_type;
+  template <typename U> struct rebind {
+    using other = SlabAllocator<U, SlabCapacity>;
+  };
+
+  ///=== [I] Special Functions.
+  /// Default constructor.
+  SlabAllocator() = default;
+  /// Copies start with an empty pool.
+  SlabAllocator(const SlabAllocator &) {}
+  /// Rebound copies start with an empty pool.
+  template <typename U> SlabAllocator(const SlabAllocator<U, SlabCapacity> &) {}
+  /// Takes the slabs of "other".
+  SlabAllocator(SlabAllocator &&other) noexcept { swap(other); }
+  /// Keeps its own pool.
+  SlabAllocator &operator=(const SlabAllocator &) { return *this; }
+  /// Releases its slabs and takes the ones of "other".
+  SlabAllocator &operator=(SlabAllocator &&other) noexcept {
+    release();
+    swap(other);
+    return *this;
+  }
+  /// Returns every slab to the system.
+  ~SlabAllocator() { release(); }
+
+  ///=== [II] Allocation.
+  /*!
+   * Allocates storage for "count" objects, taking it from the free list or
+   * from the current slab when "count" is 1.
+   */
+  T *allocate(size_type count) {
+    if (count != 1) {
+      return static_cast<T *>(::operator new(count * sizeof(T)));
+    }
+    if (m_free_list != nullptr) {
+      Slot *slot = m_free_list;
+      m_free_list = slot->next;
+      return reinterpret_cast<T *>(slot);
+    }
+    if (m_slabs.empty() or m_used == SlabCapacity) {
+      m_slabs.push_back(new Slot[SlabCapacity]);
+      m_used = 0;
+    }
+    return reinterpret_cast<T *>(&m_slabs.back()[m_used++]);
+  }
+  /// Puts the storage pointed by "pointer" back in the free list.
+  void deallocate(T *pointer, size_type count) {
+    if (count != 1) {
+      ::operator delete(pointer);
+      return;
+    }
+    Slot *slot = reinterpret_cast<Slot *>(pointer);
+    slot->next = m_free_list;
+    m_free_list = slot;
+  }
+  /*!
+   * Returns every slab to the system at once. Objects still living in the
+   * pool are not destroyed, so this is only safe once they are dead or
+   * trivially destructible.
+   */
+  void release() {
+    for (Slot *slab : m_slabs) {
+      delete[] slab;
+    }
+    m_slabs.clear();
+    m_free_list = nullptr;
+    m_used = 0;
+  }
+  /// Exchanges the pools of two allocators.
+  void swap(SlabAllocator &other) noexcept {
+    std::swap(m_slabs, other.m_slabs);
+    std::swap(m_free_list, other.m_free_list);
+    std::swap(m_used, other.m_used);
+  }
+
+  friend bool operator==(const SlabAllocator &lhs, const SlabAllocator &rhs) {
+    return &lhs == &rhs;
+  }
+  friend bool operator!=(const SlabAllocator &lhs, const SlabAllocator &rhs) {
+    return !(lhs == rhs);
+  }
+  friend void swap(SlabAllocator &lhs, SlabAllocator &rhs) noexcept {
+    lhs.swap(rhs);
+  }
+
+private:
+  union Slot {
+    Slot *next;
+    alignas(T) unsigned char storage[sizeof(T)];
+  };
+
+  std::vector<Slot *> m_slabs; //!< Slabs owned by the pool.
+  Slot *m_free_list{nullptr};  //!< Slots freed and not yet reused.
+  size_type m_used{0};         //!< Slots handed out from the last slab.
+};
+
+/*!
+ * Whether "Alloc" can drop all of its memory at once through release(), so a
+ * container of trivially destructible nodes may skip visiting each of them.
+ */
+template <typename Alloc, typename = void>
+struct releases_in_bulk : std::false_type {};
+template <typename Alloc>
+struct releases_in_bulk<
+    Alloc, std::void_t<decltype(std::declval<Alloc &>().release())>>
+    : std::true_type {};
+} // namespace tree
+
+#endif // #ifndef SLAB_ALLOCATOR_H
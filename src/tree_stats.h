@@ -0,0 +1,57 @@
+#ifndef TREE_STATS_H
+#define TREE_STATS_H
+
+#include <cstddef> // size_t
+#include <string>
+#include <vector>
+
+// Namespace for tree data-structures.
+namespace tree {
+/*!
+ * Result of the validate() member of the trees: whether every invariant held
+ * and the shape of the tree, gathered in the same O(n) traversal.
+ */
+struct TreeStats {
+  bool valid{true};   //!< Whether every invariant checked held.
+  std::string error;  //!< First invariant found broken, if any.
+  size_t node_count{0};
+  size_t height{0};        //!< Nodes on the longest root-to-leaf path.
+  size_t black_height{0};  //!< Black nodes on every root-to-leaf path (RB).
+  std::vector<size_t> nodes_per_depth; //!< Histogram, the root at depth 0.
+
+  /*!
+   * Average number of nodes visited by a successful search, i.e. the mean
+   * depth plus one; about log2(n) in a well balanced tree and n / 2 in a
+   * degenerate one.
+   */
+  double average_path_length() const {
+    if (node_count == 0) {
+      return 0;
+    }
+    double total = 0;
+    for (size_t depth = 0; depth < nodes_per_depth.size(); ++depth) {
+      total += static_cast<double>(nodes_per_depth[depth]) * (depth + 1);
+    }
+    return total / node_count;
+  }
+
+  /// Records a node at "depth".
+  void count_node(size_t depth) {
+    if (nodes_per_depth.size() <= depth) {
+      nodes_per_depth.resize(depth + 1, 0);
+      height = depth + 1;
+    }
+    ++nodes_per_depth[depth];
+    ++node_count;
+  }
+  /// Marks the tree invalid, keeping the first "message" reported.
+  void fail(const std::string &message) {
+    if (valid) {
+      valid = false;
+      error = message;
+    }
+  }
+};
+} // namespace tree
+
+#endif // #ifndef TREE_STATS_H